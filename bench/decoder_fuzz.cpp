@@ -0,0 +1,49 @@
+/**
+ * @brief libFuzzer target comparing the vectorized decoder and CRC kernels with the scalar ones
+ *
+ * The first input byte selects the decoder, the next eight seed the chunk sizes, and the rest is
+ * the byte stream. Any disagreement with the scalar kernels, or a wrong CRC check value, aborts, i.e.
+ *   serial_fuzz -max_len=65536 corpus/
+ */
+#include <cstdio>
+#include <cstdlib>
+#include "serial_lite.h"
+#include "frames.h"
+
+static void check(const char *what, const char *kernel) {
+    if (kernel != nullptr) {
+        fprintf(stderr, "%s: %s kernels disagree with scalar\n", what, kernel);
+        abort();
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size <= 9)
+        return 0;
+    uint8_t decoder = data[0];
+    uint64_t seed;
+    memcpy(&seed, data + 1, sizeof(seed));
+    data += 9;
+    size -= 9;
+
+    /* the length prefix and Modbus decoders use no simd kernels, they are decoded once for the sanitizers */
+    switch (decoder % 5) {
+        case 0: check("newline", diff_kernels<DelimiterDecoder<'\n'>>(data, size, seed)); break;
+        case 1: check("cobs", diff_kernels<CobsDecoder>(data, size, seed)); break;
+        case 2: check("slip", diff_kernels<SlipDecoder>(data, size, seed)); break;
+        case 3: decode_stream<LengthPrefixDecoder<2, true>>(data, size, seed); break;
+        case 4: decode_stream<ModbusRtuDecoder>(data, size, seed); break;
+    }
+    check("crc", diff_crc_kernels(data, size, seed));
+
+    /* SLIP escaping must round trip with every kernel table */
+    std::vector<uint8_t> escaped(2 * size);
+    for (const simd::Kernels& k : simd::available_kernels()) {
+        simd::use_kernels(k.name);
+        size_t len = simd::slip_escape(data, size, escaped.data());
+        if (!simd::slip_unescape(escaped.data(), len) || len != size || memcmp(escaped.data(), data, size) != 0)
+            check("slip_escape", k.name);
+    }
+    simd::use_kernels(simd::available_kernels().front().name);
+    return 0;
+}
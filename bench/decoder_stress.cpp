@@ -0,0 +1,204 @@
+/**
+ * @brief Differential stress test and speed comparison of the scalar and vectorized decoder kernels
+ *
+ * Random streams of valid frames mixed with garbage are decoded in random chunk sizes with every
+ * kernel table available on this CPU, and the results must equal those of the scalar kernels.
+ * The CRC kernels must give the standard check values and agree with the lookup tables.
+ * The speed of each decoder, CRC and kernel table is then written to stdout as JSON, i.e.
+ *   serial_stress > decoders.json
+ *   serial_stress --seed 7 --iterations 100000
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "serial_lite.h"
+#include "frames.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    uint64_t seed{1};
+    //! random streams compared per decoder
+    size_t iterations{2000};
+    //! stream length of the speed runs
+    size_t bytes{(size_t)16 << 20};
+};
+
+using Encoder = void (*)(const std::vector<uint8_t>&, std::vector<uint8_t>&);
+
+static uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Build a stream of encoded random payloads, with garbage between some frames
+ * @param garbage probability in percent of random bytes before a frame
+ */
+static std::vector<uint8_t> random_stream(Rng& rng, Encoder encode, size_t len, unsigned garbage) {
+    std::vector<uint8_t> stream, payload;
+    while (stream.size() < len) {
+        payload.resize(rng.range(0, 300));
+        /* few distinct values, so that delimiters and escapes are frequent */
+        uint64_t alphabet = rng.range(2, 256);
+        for (uint8_t& byte : payload)
+            byte = (uint8_t)(rng.next() % alphabet);
+        if (rng.range(1, 100) <= garbage) {
+            for (size_t n = rng.range(1, 40); n > 0; --n)
+                stream.push_back((uint8_t)rng.next());
+        }
+        encode(payload, stream);
+    }
+    return stream;
+}
+
+/**
+ * @brief Compare all kernel tables on random streams
+ * @return Number of streams on which a kernel table disagreed with the scalar kernels
+ */
+template <typename Decoder>
+static size_t stress(const Options& options, const char *name, Encoder encode) {
+    Rng rng(options.seed);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < options.iterations; ++i) {
+        std::vector<uint8_t> stream = random_stream(rng, encode, rng.range(1, 8192), (unsigned)rng.range(0, 50));
+        uint64_t seed = rng.next();
+        if (const char *kernel = diff_kernels<Decoder>(stream.data(), stream.size(), seed)) {
+            if (mismatches++ == 0) {
+                fprintf(stderr, "%s: %s kernels disagree with scalar, stream %zu of seed %llu\n",
+                        name, kernel, i, (unsigned long long)options.seed);
+            }
+        }
+        if (const char *kernel = diff_crc_kernels(stream.data(), stream.size(), seed)) {
+            if (mismatches++ == 0)
+                fprintf(stderr, "%s: %s CRC kernels disagree, stream %zu\n", name, kernel, i);
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * @brief Time a decoder over a large stream, best of three runs
+ * @param scans true if the decoder uses the simd kernels, which are then timed one table at a time
+ */
+template <typename Decoder>
+static void speed(const Options& options, const char *name, Encoder encode, bool scans,
+                  std::vector<std::string>& results) {
+    Rng rng(options.seed);
+    std::vector<uint8_t> stream = random_stream(rng, encode, options.bytes, 0);
+    std::vector<const char *> tables;
+    for (const simd::Kernels& k : simd::available_kernels())
+        tables.push_back(k.name);
+    if (!scans)
+        tables = {"none"};
+    for (const char *table : tables) {
+        if (scans)
+            simd::use_kernels(table);
+        double best_s = INFINITY;
+        uint64_t best_cycles = UINT64_MAX;
+        size_t frames = 0;
+        for (int run = 0; run < 3; ++run) {
+            auto start = Clock::now();
+            uint64_t start_cycles = cycles();
+            frames = decode_stream<Decoder>(stream.data(), stream.size(), run, 4096, 8192).ends.size();
+            best_cycles = std::min(best_cycles, cycles() - start_cycles);
+            best_s = std::min(best_s, std::chrono::duration<double>(Clock::now() - start).count());
+        }
+        char entry[256];
+        snprintf(entry, sizeof(entry),
+                 "{\"name\": \"decode\", \"decoder\": \"%s\", \"kernels\": \"%s\", \"frames\": %zu, "
+                 "\"mb_per_s\": %.6g, \"cycles_per_byte\": %.6g}",
+                 name, table, frames, stream.size() / best_s / 1e6, (double)best_cycles / stream.size());
+        results.push_back(entry);
+    }
+    simd::use_kernels(simd::available_kernels().front().name);
+}
+
+/**
+ * @brief Time CRC-32 and CRC-32C of every CRC kernel table, best of three runs
+ */
+static void crc_speed(const Options& options, std::vector<std::string>& results) {
+    Rng rng(options.seed);
+    std::vector<uint8_t> data(options.bytes);
+    for (uint8_t& byte : data)
+        byte = (uint8_t)rng.next();
+    for (const simd::CrcKernels& k : simd::available_crc_kernels()) {
+        for (auto [variant, update] : {std::pair{"crc32", k.crc32}, std::pair{"crc32c", k.crc32c}}) {
+            double best_s = INFINITY;
+            uint64_t best_cycles = UINT64_MAX;
+            /* kept in a volatile, so that the checksum is not optimized away */
+            volatile uint32_t crc = 0;
+            for (int run = 0; run < 3; ++run) {
+                auto start = Clock::now();
+                uint64_t start_cycles = cycles();
+                crc = update(0xFFFFFFFF, data.data(), data.size());
+                best_cycles = std::min(best_cycles, cycles() - start_cycles);
+                best_s = std::min(best_s, std::chrono::duration<double>(Clock::now() - start).count());
+            }
+            (void)crc;
+            char entry[256];
+            snprintf(entry, sizeof(entry),
+                     "{\"name\": \"crc\", \"variant\": \"%s\", \"kernels\": \"%s\", "
+                     "\"mb_per_s\": %.6g, \"cycles_per_byte\": %.6g}",
+                     variant, k.name, data.size() / best_s / 1e6, (double)best_cycles / data.size());
+            results.push_back(entry);
+        }
+    }
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [--seed N] [--iterations N] [--bytes N]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--seed")
+            options.seed = std::stoull(value);
+        else if (arg == "--iterations")
+            options.iterations = std::stoull(value);
+        else if (arg == "--bytes")
+            options.bytes = std::max(1ull, std::stoull(value));
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    size_t mismatches = 0;
+    mismatches += stress<DelimiterDecoder<'\n'>>(options, "newline", encode_newline);
+    mismatches += stress<CobsDecoder>(options, "cobs", encode_cobs);
+    mismatches += stress<SlipDecoder>(options, "slip", encode_slip);
+    /* the length prefix and Modbus decoders use no simd kernels, so they are only timed */
+    if (const char *kernel = check_crc_kernels()) {
+        fprintf(stderr, "%s CRC kernels give wrong check values\n", kernel);
+        ++mismatches;
+    }
+
+    std::vector<std::string> results;
+    speed<DelimiterDecoder<'\n'>>(options, "newline", encode_newline, true, results);
+    speed<CobsDecoder>(options, "cobs", encode_cobs, true, results);
+    speed<SlipDecoder>(options, "slip", encode_slip, true, results);
+    speed<LengthPrefixDecoder<2, true>>(options, "length_prefix", encode_length_prefix, false, results);
+    speed<ModbusRtuDecoder>(options, "modbus_rtu", encode_modbus, false, results);
+    crc_speed(options, results);
+
+    printf("{\n  \"seed\": %llu,\n  \"iterations\": %zu,\n  \"mismatches\": %zu,\n  \"crc\": \"%s\",\n"
+           "  \"benchmarks\": [\n", (unsigned long long)options.seed, options.iterations, mismatches,
+           simd::crc_kernels().name);
+    for (size_t i = 0; i < results.size(); ++i)
+        printf("    %s%s\n", results[i].c_str(), i + 1 < results.size() ? "," : "");
+    printf("  ]\n}\n");
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+/**
+ * @brief Frame encoders and differential decoding, shared by the benchmarks and the fuzz target
+ */
+#ifndef SERIAL_BENCH_FRAMES_H
+#define SERIAL_BENCH_FRAMES_H
+
+#include <vector>
+#include "serial_lite.h"
+
+using namespace serial;
+
+inline void encode_newline(const std::vector<uint8_t>& payload, std::vector<uint8_t>& out) {
+    out.insert(out.end(), payload.begin(), payload.end());
+    out.push_back('\n');
+}
+
+inline void encode_cobs(const std::vector<uint8_t>& payload, std::vector<uint8_t>& out) {
+    size_t code_pos = out.size();
+    out.push_back(1);
+    for (uint8_t byte : payload) {
+        if (byte != 0) {
+            out.push_back(byte);
+            ++out[code_pos];
+        }
+        if (byte == 0 || out[code_pos] == 0xFF) {
+            code_pos = out.size();
+            out.push_back(1);
+        }
+    }
+    out.push_back(0);
+}
+
+inline void encode_slip(const std::vector<uint8_t>& payload, std::vector<uint8_t>& out) {
+    size_t pos = out.size();
+    out.resize(pos + 2 * payload.size());
+    out.resize(pos + simd::slip_escape(payload.data(), payload.size(), out.data() + pos));
+    out.push_back(simd::slip_end);
+}
+
+inline void encode_length_prefix(const std::vector<uint8_t>& payload, std::vector<uint8_t>& out) {
+    out.push_back((uint8_t)(payload.size() >> 8));
+    out.push_back((uint8_t)payload.size());
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+//! read holding registers response of slave 1, the payload is cut to 250 bytes
+inline void encode_modbus(const std::vector<uint8_t>& payload, std::vector<uint8_t>& out) {
+    size_t pos = out.size();
+    size_t len = std::min<size_t>(payload.size(), 250);
+    out.push_back(1);
+    out.push_back(modbus::read_holding_registers);
+    out.push_back((uint8_t)len);
+    out.insert(out.end(), payload.begin(), payload.begin() + len);
+    uint16_t crc = Crc16Modbus::compute(out.data() + pos, out.size() - pos);
+    out.push_back((uint8_t)crc);
+    out.push_back((uint8_t)(crc >> 8));
+}
+
+/**
+ * @brief xorshift64*, deterministic for a seed on every platform
+ */
+class Rng {
+public:
+    explicit Rng(uint64_t seed) : state_(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+    uint64_t next() {
+        state_ ^= state_ >> 12;
+        state_ ^= state_ << 25;
+        state_ ^= state_ >> 27;
+        return state_ * 0x2545F4914F6CDD1Dull;
+    }
+
+    //! uniform in [lo, hi]
+    size_t range(size_t lo, size_t hi) {
+        return lo + next() % (hi - lo + 1);
+    }
+
+private:
+    uint64_t state_;
+};
+
+/**
+ * @brief Everything a FrameReader produced from a stream
+ */
+struct DecodeResult {
+    //! decoded frames back to back
+    std::vector<uint8_t> bytes;
+    //! end offset of each frame in bytes
+    std::vector<size_t> ends;
+    size_t dropped{0};
+    size_t overflows{0};
+
+    bool operator==(const DecodeResult&) const = default;
+};
+
+/**
+ * @brief Feed a stream through a FrameReader in random chunk sizes
+ * @param data Stream bytes
+ * @param len Stream length
+ * @param seed Seed of the chunk sizes
+ * @param max_chunk Largest chunk fed at once
+ * @param capacity Receive buffer size of the reader
+ */
+template <typename Decoder>
+inline DecodeResult decode_stream(const uint8_t *data, size_t len, uint64_t seed,
+                                  size_t max_chunk = 512, size_t capacity = 1024) {
+    /* the reader is fed through prepare() and commit(), the transport is never read */
+    static MemoryPipe idle(1);
+    FrameReader<Decoder> reader(idle.a(), capacity);
+    Rng rng(seed);
+    DecodeResult result;
+    std::span<const uint8_t> frame;
+    for (size_t pos = 0; pos < len;) {
+        std::span<uint8_t> region = reader.prepare();
+        size_t n = std::min({rng.range(1, max_chunk), region.size(), len - pos});
+        memcpy(region.data(), data + pos, n);
+        reader.commit(n);
+        pos += n;
+        while (reader.next(frame)) {
+            result.bytes.insert(result.bytes.end(), frame.begin(), frame.end());
+            result.ends.push_back(result.bytes.size());
+        }
+    }
+    result.dropped = reader.dropped();
+    result.overflows = reader.overflows();
+    return result;
+}
+
+/**
+ * @brief Decode a stream with every available kernel table and compare to the scalar kernels
+ * @note Only meaningful for decoders scanning with simd::find_byte, i.e. newline, COBS and SLIP
+ * @return Name of the first kernel table that disagrees, nullptr if all agree
+ */
+template <typename Decoder>
+inline const char *diff_kernels(const uint8_t *data, size_t len, uint64_t seed) {
+    const char *disagrees = nullptr;
+    simd::use_kernels("scalar");
+    DecodeResult expected = decode_stream<Decoder>(data, len, seed);
+    for (const simd::Kernels& k : simd::available_kernels()) {
+        simd::use_kernels(k.name);
+        if (!(decode_stream<Decoder>(data, len, seed) == expected)) {
+            disagrees = k.name;
+            break;
+        }
+    }
+    simd::use_kernels(simd::available_kernels().front().name);
+    return disagrees;
+}
+
+/**
+ * @brief Check every CRC kernel table against the standard check values, so that a bug shared with the lookup tables is caught
+ * @return Name of the first kernel table giving a wrong check value, nullptr if all are right
+ */
+inline const char *check_crc_kernels() {
+    static const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    for (const simd::CrcKernels& k : simd::available_crc_kernels()) {
+        if ((k.crc32(0xFFFFFFFF, check, sizeof(check)) ^ 0xFFFFFFFF) != 0xCBF43926 ||
+            (k.crc32c(0xFFFFFFFF, check, sizeof(check)) ^ 0xFFFFFFFF) != 0xE3069283)
+            return k.name;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Checksum a stream in random pieces with every CRC kernel table and compare to the lookup tables
+ * @return Name of the first kernel table that disagrees, nullptr if all agree
+ */
+inline const char *diff_crc_kernels(const uint8_t *data, size_t len, uint64_t seed) {
+    if (const char *wrong = check_crc_kernels())
+        return wrong;
+    const char *disagrees = nullptr;
+    uint32_t crc32 = Crc32::update_table(0xFFFFFFFF, data, len);
+    uint32_t crc32c = Crc32c::update_table(0xFFFFFFFF, data, len);
+    for (const simd::CrcKernels& k : simd::available_crc_kernels()) {
+        Rng rng(seed);
+        uint32_t a = 0xFFFFFFFF, b = 0xFFFFFFFF;
+        for (size_t pos = 0; pos < len;) {
+            size_t n = std::min(rng.range(1, 300), len - pos);
+            a = k.crc32(a, data + pos, n);
+            b = k.crc32c(b, data + pos, n);
+            pos += n;
+        }
+        if (a != crc32 || b != crc32c) {
+            disagrees = k.name;
+            break;
+        }
+    }
+    return disagrees;
+}
+
+#endif
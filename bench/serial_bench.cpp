@@ -0,0 +1,453 @@
+/**
+ * @brief Throughput and latency benchmark of serial_lite over pty pairs or real loopback hardware
+ *
+ * Results are written to stdout as JSON, i.e.
+ *   serial_bench > pty.json
+ *   serial_bench --device /dev/ttyUSB0 --peer /dev/ttyUSB1 --baudrate 3000000 > usb.json
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <pty.h>
+#include "serial_lite.h"
+#include "frames.h"
+
+using namespace serial;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    //! device under test, a pty pair is created if empty
+    std::string device;
+    //! far end of the device under test, i.e. wired by a null modem cable
+    std::string peer;
+    int baudrate{115200};
+    //! bytes moved per throughput run, 0 for a default depending on the link
+    size_t bytes{0};
+    //! round trips per latency run
+    size_t iterations{2000};
+    //! devices served by the poller
+    size_t ports{8};
+};
+
+/**
+ * @brief Device under test and the file descriptor of its far end
+ */
+class Link {
+public:
+    static std::unique_ptr<Link> open(const Options& options) {
+        std::unique_ptr<Link> link(new Link());
+        std::string name = options.device;
+        if (name.empty()) {
+            int slave;
+            char pty_name[64];
+            if (openpty(&link->peer_fd_, &slave, pty_name, nullptr, nullptr) != 0)
+                return nullptr;
+            name = pty_name;
+            link->serial_.reset(new Serial(name, options.baudrate));
+            bool ok = link->serial_->init();
+            /* the master reads EIO once no slave is open, so close ours only after init */
+            close(slave);
+            if (!ok)
+                return nullptr;
+            fcntl(link->peer_fd_, F_SETFL, fcntl(link->peer_fd_, F_GETFL) | O_NONBLOCK);
+            return link;
+        }
+        link->serial_.reset(new Serial(name, options.baudrate));
+        link->peer_.reset(new Serial(options.peer, options.baudrate));
+        if (!link->serial_->init() || !link->peer_->init())
+            return nullptr;
+        link->peer_fd_ = link->peer_->native_handle();
+        return link;
+    }
+
+    ~Link() {
+        serial_.reset();
+        if (!peer_ && peer_fd_ >= 0)
+            close(peer_fd_);
+    }
+
+    Serial& serial() {
+        return *serial_;
+    }
+
+    int peer_fd() const {
+        return peer_fd_;
+    }
+
+private:
+    Link() = default;
+
+    std::unique_ptr<Serial> serial_;
+    //! far end when running on hardware
+    std::unique_ptr<Serial> peer_;
+    //! non-blocking far end, the pty master or the peer device
+    int peer_fd_{-1};
+};
+
+/**
+ * @brief Write all bytes to a non-blocking fd
+ * @return False if failed or stopped
+ */
+static bool write_all(int fd, const uint8_t *data, size_t len, const std::atomic<bool>& stop) {
+    while (len > 0 && !stop.load(std::memory_order_relaxed)) {
+        ssize_t r = ::write(fd, data, len);
+        if (r > 0) {
+            data += r;
+            len -= r;
+        } else if (r < 0 && errno == EAGAIN) {
+            pollfd pfd{fd, POLLOUT, 0};
+            ::poll(&pfd, 1, 100);
+        } else if (r < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    return len == 0;
+}
+
+/**
+ * @brief Producer thread writing a pattern to the far end until len bytes were sent
+ */
+static std::thread produce(int fd, const std::vector<uint8_t>& pattern, size_t len, const std::atomic<bool>& stop) {
+    return std::thread([fd, &pattern, len, &stop] {
+        for (size_t sent = 0; sent < len;) {
+            size_t n = std::min(pattern.size(), len - sent);
+            if (!write_all(fd, pattern.data(), n, stop))
+                return;
+            sent += n;
+        }
+    });
+}
+
+/**
+ * @brief Collects benchmark results and prints them as one JSON document
+ */
+class Report {
+public:
+    void begin(const std::string& name) {
+        entries_.push_back("{\"name\": \"" + name + "\"");
+    }
+
+    void add(const std::string& key, double value) {
+        char buf[64];
+        /* counts are printed exactly, rates with 6 significant digits */
+        if (value == (double)(long long)value && std::abs(value) < 1e15)
+            snprintf(buf, sizeof(buf), "%lld", (long long)value);
+        else
+            snprintf(buf, sizeof(buf), "%.6g", value);
+        entries_.back() += ", \"" + key + "\": " + buf;
+    }
+
+    void add(const std::string& key, const std::string& value) {
+        entries_.back() += ", \"" + key + "\": \"" + value + "\"";
+    }
+
+    void end() {
+        entries_.back() += "}";
+    }
+
+    void print(const Options& options) const {
+        printf("{\n  \"link\": \"%s\",\n  \"baudrate\": %d,\n  \"simd\": \"%s\",\n  \"benchmarks\": [\n",
+               options.device.empty() ? "pty" : options.device.c_str(), options.baudrate, simd::kernels().name);
+        for (size_t i = 0; i < entries_.size(); ++i)
+            printf("    %s%s\n", entries_[i].c_str(), i + 1 < entries_.size() ? "," : "");
+        printf("  ]\n}\n");
+    }
+
+private:
+    std::vector<std::string> entries_;
+};
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @brief Syscalls spent per KB moved
+ * @param stats counters of the device, reads and writes count one syscall each
+ * @param waits syscalls spent waiting outside of read() and write(), i.e. ppoll, FIONREAD, epoll_wait
+ * @param bytes bytes moved
+ */
+static double syscalls_per_kb(const SerialStats& stats, double waits, size_t bytes) {
+    if (bytes == 0)
+        return 0.0;
+    return (stats.read_calls + stats.write_calls + waits) / (bytes / 1024.0);
+}
+
+/**
+ * @brief Stream bytes from the far end and read them with a fixed read size
+ */
+static bool bench_throughput(const Options& options, size_t read_size, Report& report) {
+    std::unique_ptr<Link> link = Link::open(options);
+    if (!link)
+        return false;
+    Serial& serial = link->serial();
+    serial.enable_stats();
+    std::vector<uint8_t> pattern(4096);
+    for (size_t i = 0; i < pattern.size(); ++i)
+        pattern[i] = (uint8_t)i;
+    std::vector<uint8_t> buf(read_size);
+    std::atomic<bool> stop{false};
+    size_t received = 0, waits = 0;
+    auto start = Clock::now();
+    std::thread producer = produce(link->peer_fd(), pattern, options.bytes, stop);
+    while (received < options.bytes) {
+        ++waits;
+        if (serial.wait_readable(1000000000) < 0)
+            break;
+        long long r = serial.read(buf.data(), buf.size());
+        if (r < 0 && errno != EAGAIN)
+            break;
+        if (r > 0)
+            received += r;
+    }
+    double elapsed = seconds_since(start);
+    stop.store(true);
+    producer.join();
+    SerialStats stats = serial.stats();
+    report.begin("throughput");
+    report.add("read_size", read_size);
+    report.add("bytes", received);
+    report.add("mb_per_s", received / elapsed / 1e6);
+    /* each wait is a ppoll and a FIONREAD ioctl */
+    report.add("syscalls_per_kb", syscalls_per_kb(stats, 2.0 * waits, received));
+    report.add("short_reads", stats.short_reads);
+    report.end();
+    return received == options.bytes;
+}
+
+/**
+ * @brief Echo messages through the far end and record the round trip time
+ */
+static bool bench_round_trip(const Options& options, size_t message_size, Report& report) {
+    std::unique_ptr<Link> link = Link::open(options);
+    if (!link)
+        return false;
+    Serial& serial = link->serial();
+    serial.enable_stats();
+    std::atomic<bool> stop{false};
+    int peer = link->peer_fd();
+    std::thread echo([peer, &stop] {
+        uint8_t buf[4096];
+        while (!stop.load(std::memory_order_relaxed)) {
+            pollfd pfd{peer, POLLIN, 0};
+            if (::poll(&pfd, 1, 100) <= 0)
+                continue;
+            ssize_t r = ::read(peer, buf, sizeof(buf));
+            if (r > 0 && !write_all(peer, buf, r, stop))
+                return;
+        }
+    });
+    std::vector<uint8_t> message(message_size, 0x5A), reply(message_size);
+    LatencyHistogram histogram;
+    size_t lost = 0;
+    for (size_t i = 0; i < options.iterations; ++i) {
+        auto start = Clock::now();
+        if (serial.write(message.data(), message.size()) != (long long)message.size()) {
+            ++lost;
+            continue;
+        }
+        ReadProgress progress = serial.read_exact(reply.data(), reply.size(), start + std::chrono::seconds(1));
+        if (!progress) {
+            ++lost;
+            continue;
+        }
+        histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+    stop.store(true);
+    echo.join();
+    HistogramSnapshot snapshot = histogram.snapshot();
+    SerialStats stats = serial.stats();
+    report.begin("round_trip");
+    report.add("message_size", message_size);
+    report.add("iterations", snapshot.count);
+    report.add("lost", lost);
+    report.add("p50_us", snapshot.percentile(50) / 1e3);
+    report.add("p90_us", snapshot.percentile(90) / 1e3);
+    report.add("p99_us", snapshot.percentile(99) / 1e3);
+    report.add("p999_us", snapshot.percentile(99.9) / 1e3);
+    report.add("max_us", snapshot.max / 1e3);
+    report.add("mean_us", snapshot.mean() / 1e3);
+    /* read_exact() polls once after each read finding no data, bytes count both directions */
+    report.add("syscalls_per_kb", syscalls_per_kb(stats, stats.read_eagain, stats.rx_bytes + stats.tx_bytes));
+    report.end();
+    return lost == 0;
+}
+
+/**
+ * @brief Stream encoded frames from the far end and decode them with a FrameReader
+ */
+template <typename Decoder>
+static bool bench_framing(const Options& options, const char *mode,
+                          void (*encode)(const std::vector<uint8_t>&, std::vector<uint8_t>&), Report& report) {
+    std::unique_ptr<Link> link = Link::open(options);
+    if (!link)
+        return false;
+    /* printable payload, so that the newline delimiter never occurs inside */
+    std::vector<uint8_t> payload(64);
+    for (size_t i = 0; i < payload.size(); ++i)
+        payload[i] = 'A' + i % 26;
+    payload[7] = simd::slip_end;
+    payload[9] = 0;
+    if (std::string(mode) == "newline")
+        payload[7] = payload[9] = 'x';
+    std::vector<uint8_t> stream;
+    while (stream.size() < 4096 - 2 * payload.size() - 4)
+        encode(payload, stream);
+    size_t frames_per_stream = 0;
+    for (std::vector<uint8_t> one; one.size() < stream.size(); encode(payload, one))
+        ++frames_per_stream;
+    size_t repeats = std::max<size_t>(1, options.bytes / stream.size());
+    size_t expected = repeats * frames_per_stream;
+
+    link->serial().enable_stats();
+    FrameReader<Decoder> reader(link->serial(), 4096);
+    std::atomic<bool> stop{false};
+    size_t frames = 0, payload_bytes = 0, waits = 0;
+    auto start = Clock::now();
+    std::thread producer = produce(link->peer_fd(), stream, repeats * stream.size(), stop);
+    while (frames < expected) {
+        ++waits;
+        if (link->serial().wait_readable(1000000000) < 0)
+            break;
+        reader.poll([&](std::span<const uint8_t> frame) {
+            ++frames;
+            payload_bytes += frame.size();
+        });
+    }
+    double elapsed = seconds_since(start);
+    stop.store(true);
+    producer.join();
+    report.begin("framing");
+    report.add("mode", mode);
+    report.add("frames", frames);
+    report.add("frames_per_s", frames / elapsed);
+    report.add("payload_mb_per_s", payload_bytes / elapsed / 1e6);
+    SerialStats stats = link->serial().stats();
+    /* each wait is a ppoll and a FIONREAD ioctl */
+    report.add("syscalls_per_kb", syscalls_per_kb(stats, 2.0 * waits, stats.rx_bytes));
+    report.add("dropped", reader.dropped());
+    report.end();
+    return frames == expected && reader.dropped() == 0;
+}
+
+/**
+ * @brief Stream bytes to many pty pairs at once and serve them with one SerialPoller
+ */
+static bool bench_poller(const Options& options, Report& report) {
+    std::vector<std::unique_ptr<Link>> links;
+    for (size_t i = 0; i < options.ports; ++i) {
+        links.emplace_back(Link::open(options));
+        if (!links.back())
+            return false;
+    }
+    std::vector<uint8_t> pattern(1024, 0xA5);
+    size_t per_port = options.bytes / options.ports;
+    std::atomic<bool> stop{false};
+    std::thread producer([&] {
+        for (size_t sent = 0; sent < per_port; sent += pattern.size()) {
+            for (auto& link : links) {
+                if (!write_all(link->peer_fd(), pattern.data(), std::min(pattern.size(), per_port - sent), stop))
+                    return;
+            }
+        }
+    });
+    SerialPoller poller;
+    size_t received = 0, callbacks = 0;
+    uint8_t buf[4096];
+    for (auto& link : links) {
+        link->serial().enable_stats();
+        poller.add(link->serial(), [&](Serial& serial, uint32_t) {
+            ++callbacks;
+            long long r;
+            while ((r = serial.read(buf, sizeof(buf))) > 0)
+                received += r;
+        });
+    }
+    size_t waits = 0;
+    auto start = Clock::now();
+    while (received < per_port * options.ports) {
+        ++waits;
+        if (poller.poll(1000000000) <= 0)
+            break;
+    }
+    double elapsed = seconds_since(start);
+    stop.store(true);
+    producer.join();
+    report.begin("poller");
+    report.add("ports", options.ports);
+    report.add("bytes", received);
+    report.add("mb_per_s", received / elapsed / 1e6);
+    report.add("bytes_per_callback", callbacks ? (double)received / callbacks : 0.0);
+    SerialStats stats;
+    for (auto& link : links) {
+        SerialStats port = link->serial().stats();
+        stats.read_calls += port.read_calls;
+        stats.write_calls += port.write_calls;
+    }
+    /* each wait is one epoll_wait serving all ports */
+    report.add("syscalls_per_kb", syscalls_per_kb(stats, waits, received));
+    report.end();
+    return received == per_port * options.ports;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [--device PATH --peer PATH] [--baudrate N] [--bytes N] [--iterations N] [--ports N]\n"
+            "  without --device the benchmarks run over pty pairs\n",
+            program);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--device")
+            options.device = value;
+        else if (arg == "--peer")
+            options.peer = value;
+        else if (arg == "--baudrate")
+            options.baudrate = std::stoi(value);
+        else if (arg == "--bytes")
+            options.bytes = std::stoull(value);
+        else if (arg == "--iterations")
+            options.iterations = std::stoull(value);
+        else if (arg == "--ports")
+            options.ports = std::max(1ull, std::stoull(value));
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!options.device.empty() && options.peer.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (options.bytes == 0) {
+        /* about two seconds of transfer on hardware, ptys are not rate limited */
+        options.bytes = options.device.empty() ? (size_t)32 << 20 : (size_t)options.baudrate / 10 * 2;
+    }
+
+    Report report;
+    bool ok = true;
+    for (size_t read_size : {64, 256, 1024, 4096})
+        ok &= bench_throughput(options, read_size, report);
+    for (size_t message_size : {1, 32, 256})
+        ok &= bench_round_trip(options, message_size, report);
+    ok &= bench_framing<DelimiterDecoder<'\n'>>(options, "newline", encode_newline, report);
+    ok &= bench_framing<CobsDecoder>(options, "cobs", encode_cobs, report);
+    ok &= bench_framing<SlipDecoder>(options, "slip", encode_slip, report);
+    ok &= bench_framing<LengthPrefixDecoder<2, true>>(options, "length_prefix", encode_length_prefix, report);
+    /* the poller needs one peer per port, which only ptys provide */
+    if (options.device.empty())
+        ok &= bench_poller(options, report);
+    report.print(options);
+    return ok ? 0 : 1;
+}
@@ -2,23 +2,119 @@
 #define __SERIAL_H__
 
 #include <string>
+#include <array>
+#include <algorithm>
 #include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <climits>
 #include <vector>
 #include <fstream>
 #include <iomanip>
 #include <filesystem>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <span>
+#include <coroutine>
+#include <optional>
+#include <exception>
+#include <utility>
+#include <unordered_map>
+#include <string_view>
+#include <mutex>
+#include <condition_variable>
 #include <termios.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <linux/serial.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define SERIAL_LITE_HAS_IO_URING
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
 
 namespace serial {
 
+#if defined(__linux__) && !defined(__powerpc__) && !defined(__mips__) && !defined(__sparc__) && !defined(__alpha__)
+#define SERIAL_LITE_HAS_TERMIOS2
+
+/**
+ * @brief Kernel termios2 layout, <asm/termbits.h> cannot be included along with <termios.h>
+ */
+struct termios2 {
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t c_line;
+    cc_t c_cc[19];
+    speed_t c_ispeed;
+    speed_t c_ospeed;
+};
+
+//! baudrate is taken from c_ispeed/c_ospeed
+constexpr tcflag_t termios2_bother = 0010000;
+//! TCGETS2 request
+constexpr unsigned long termios2_get = _IOR('T', 0x2A, termios2);
+//! TCSETS2 request
+constexpr unsigned long termios2_set = _IOW('T', 0x2B, termios2);
+#endif
+
+/**
+ * @brief Describe a buffer for the scatter/gather read and write of Serial
+ * @param data Buffer to be described
+ * @return iovec pointing at the buffer
+ */
+inline iovec buffer(std::span<const uint8_t> data) {
+    return iovec{const_cast<uint8_t *>(data.data()), data.size()};
+}
+
+inline iovec buffer(const void *data, size_t len) {
+    return iovec{const_cast<void *>(data), len};
+}
+
 /**
  * @brief serial info class
  */
 struct SerialInfo {
+    //! sysfs attributes, loaded on demand
+    enum Attribute : unsigned {
+        //! vendor_id and product_id
+        usb_id = 1,
+        product_name = 2,
+        manufacturer_name = 4,
+        //! serial_number
+        serial_id = 8,
+        all = 15
+    };
+
     std::string port_name;
     std::string port_path;
     unsigned short product_id{};
@@ -29,32 +125,96 @@ struct SerialInfo {
 
     /**
      * @brief List serial device info
+     * @param attributes Attributes to be loaded, the others stay empty until load()
      * @return Serial device info
      */
-    static std::vector<SerialInfo> list_port() {
+    static std::vector<SerialInfo> list_port(unsigned attributes = all) {
+        std::vector<SerialInfo> serial_info_list;
+        for (const auto& device_path : glob_device()) {
+            serial_info_list.emplace_back(get_info(device_path, attributes));
+        }
+        return serial_info_list;
+    }
+
+    /**
+     * @brief List the serial devices of one usb VID:PID, other devices are not read further
+     * @param attributes Attributes to be loaded for matching devices
+     */
+    static std::vector<SerialInfo> list_port(unsigned short vendor_id, unsigned short product_id,
+                                             unsigned attributes = all) {
         std::vector<SerialInfo> serial_info_list;
         for (const auto& device_path : glob_device()) {
-            serial_info_list.emplace_back(get_info(device_path));
+            SerialInfo info = get_info(device_path, usb_id);
+            if (info.vendor_id == vendor_id && info.product_id == product_id) {
+                info.load(attributes);
+                serial_info_list.emplace_back(std::move(info));
+            }
         }
         return serial_info_list;
     }
 
-    static SerialInfo get_info(const std::string& device_path) {
-        std::string device_name = std::filesystem::path(device_path).filename();
+    /**
+     * @brief Get the info of one device
+     * @param device_path Device path, i.e. /dev/ttyUSB0
+     * @param attributes Attributes to be loaded, the others stay empty until load()
+     */
+    static SerialInfo get_info(const std::string& device_path, unsigned attributes = all) {
         SerialInfo info;
-        info.port_name = device_name;
+        size_t slash = device_path.rfind('/');
+        info.port_name = slash == std::string::npos ? device_path : device_path.substr(slash + 1);
         info.port_path = device_path;
-        std::string sys_device_path = get_sys_device_path(device_name);
-        if (!sys_device_path.empty()) {
-            info.product_id = stoul(read_line(sys_device_path + "/idProduct"), nullptr, 16);
-            info.vendor_id = stoul(read_line(sys_device_path + "/idVendor"), nullptr, 16);
-            info.product = read_line(sys_device_path + "/product");
-            info.manufacturer = read_line(sys_device_path + "/manufacturer");
-            info.serial_number = read_line(sys_device_path + "/serial");
-        }
+        info.sys_device_path_ = get_sys_device_path(info.port_name);
+        info.load(attributes);
         return info;
     }
 
+    /**
+     * @brief Read attributes not loaded yet, all relative to one sysfs directory descriptor
+     * @param attributes Attributes to be loaded
+     * @return False if the device has no usb attributes
+     */
+    bool load(unsigned attributes) {
+        attributes &= ~loaded_;
+        if (attributes == 0)
+            return true;
+        if (sys_device_path_.empty())
+            return false;
+        int dir_fd = open(sys_device_path_.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd < 0)
+            return false;
+        char buf[256];
+        if (attributes & usb_id) {
+            vendor_id = read_attribute(dir_fd, "idVendor", buf) > 0 ? strtoul(buf, nullptr, 16) : 0;
+            product_id = read_attribute(dir_fd, "idProduct", buf) > 0 ? strtoul(buf, nullptr, 16) : 0;
+        }
+        if (attributes & product_name)
+            product.assign(buf, std::max(read_attribute(dir_fd, "product", buf), 0));
+        if (attributes & manufacturer_name)
+            manufacturer.assign(buf, std::max(read_attribute(dir_fd, "manufacturer", buf), 0));
+        if (attributes & serial_id)
+            serial_number.assign(buf, std::max(read_attribute(dir_fd, "serial", buf), 0));
+        close(dir_fd);
+        loaded_ |= attributes;
+        return true;
+    }
+
+    //! attributes loaded so far
+    unsigned loaded() const {
+        return loaded_;
+    }
+
+    /**
+     * @brief Check whether a device name looks like a serial port, i.e. ttyUSB0
+     */
+    static bool is_serial_name(const std::string& device_name) {
+        static constexpr const char *prefixes[] = {"ttyACM", "ttyS", "ttyUSB", "tty.", "cu.", "rfcomm"};
+        for (const char *prefix : prefixes) {
+            if (device_name.compare(0, strlen(prefix), prefix) == 0)
+                return true;
+        }
+        return false;
+    }
+
     friend std::ostream& operator<<(std::ostream& os, const SerialInfo& s) {
         os  << s.port_path << ", "
             << std::setfill('0') << std::setw(4) << std::right << std::hex << s.product_id << ":"
@@ -68,261 +228,6755 @@ struct SerialInfo {
 private:
     static std::vector<std::string> glob_device() {
         std::vector<std::string> device_path;
-        for (const auto& dir_entry : std::filesystem::directory_iterator{"/dev"}) {
-            if (dir_entry.path().filename().string().find("ttyACM") == 0)
-                device_path.emplace_back(dir_entry.path());
-            if (dir_entry.path().filename().string().find("ttyS") == 0)
-                device_path.emplace_back(dir_entry.path());
-            if (dir_entry.path().filename().string().find("ttyUSB") == 0)
-                device_path.emplace_back(dir_entry.path());
-            if (dir_entry.path().filename().string().find("tty.") == 0)
-                device_path.emplace_back(dir_entry.path());
-            if (dir_entry.path().filename().string().find("cu.") == 0)
-                device_path.emplace_back(dir_entry.path());
-            if (dir_entry.path().filename().string().find("rfcomm") == 0)
-                device_path.emplace_back(dir_entry.path());
+        DIR *dir = opendir("/dev");
+        if (dir == nullptr)
+            return device_path;
+        while (dirent *entry = readdir(dir)) {
+            if (is_serial_name(entry->d_name))
+                device_path.emplace_back(std::string("/dev/") + entry->d_name);
         }
+        closedir(dir);
         return device_path;
     }
 
+    /**
+     * @brief Resolve the usb device directory of a tty, i.e. /sys/devices/pci0000:00/.../1-1
+     * @return Empty if the tty is not a usb serial device
+     */
     static std::string get_sys_device_path(const std::string& device_name) {
-        std::filesystem::path device_path = "/sys/class/tty";
-        device_path = std::filesystem::canonical(device_path / device_name / "device");
-        if (device_name.compare(0, 6, "ttyUSB") == 0) {
-            device_path = device_path.parent_path().parent_path();
-        } else if (device_name.compare(0, 6, "ttyACM") == 0) {
-            device_path = device_path.parent_path();
-        } else {
+        unsigned levels;
+        if (device_name.compare(0, 6, "ttyUSB") == 0)
+            levels = 2;
+        else if (device_name.compare(0, 6, "ttyACM") == 0)
+            levels = 1;
+        else
             return {};
+        char resolved[PATH_MAX];
+        if (realpath(("/sys/class/tty/" + device_name + "/device").c_str(), resolved) == nullptr)
+            return {};
+        std::string device_path = resolved;
+        for (unsigned i = 0; i < levels; ++i) {
+            size_t slash = device_path.rfind('/');
+            if (slash == std::string::npos || slash == 0)
+                return {};
+            device_path.resize(slash);
         }
-        if (std::filesystem::exists(device_path)) {
-            return device_path;
-        }
-        return {};
+        return device_path;
     }
 
-    static std::string read_line(const std::string& file) {
-        std::ifstream ifs(file.c_str(), std::ifstream::in);
-        std::string line;
-        if(ifs)
-            getline(ifs, line);
-        return line;
+    /**
+     * @brief Read the first line of a sysfs attribute
+     * @return Length of the line, -1 if the attribute is missing
+     */
+    template <size_t N>
+    static int read_attribute(int dir_fd, const char *name, char (&buf)[N]) {
+        int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return -1;
+        ssize_t n;
+        while ((n = ::read(fd, buf, N - 1)) < 0 && errno == EINTR) {
+        }
+        close(fd);
+        if (n < 0)
+            return -1;
+        buf[n] = '\0';
+        char *end = (char *)memchr(buf, '\n', n);
+        if (end != nullptr) {
+            *end = '\0';
+            n = end - buf;
+        }
+        return (int)n;
     }
+
+    //! usb device directory in sysfs, empty for other devices
+    std::string sys_device_path_;
+    unsigned loaded_{0};
 };
 
 /**
- * @brief serial class
+ * @brief Cached serial device list, kept up to date by kernel hotplug events
  */
-class Serial {
+class SerialRegistry {
 public:
+    //! called with the device info and true when a device appears, false when it disappears
+    using ChangeCallback = std::function<void(const SerialInfo&, bool)>;
+
     /**
-   * @brief Constructor of serial device
-   * @param port_name port name, i.e. /dev/ttyUSB0
-   * @param baudrate serial baudrate
-   */
-    Serial(const std::string& port_name, const int baudrate) : port_name_(port_name),
-                                                  baudrate_(baudrate),
-                                                  stop_bits_(1),
-                                                  data_bits_(8),
-                                                  parity_bits_('N') {}
+     * @brief Constructor of registry, enumerates /sys/class/tty once and subscribes to hotplug events
+     */
+    SerialRegistry() : monitor_fd_(socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                          NETLINK_KOBJECT_UEVENT)) {
+        if (monitor_fd_ >= 0) {
+            sockaddr_nl addr{};
+            addr.nl_family = AF_NETLINK;
+            /* kernel uevents, udev rebroadcasts them on group 2 once rules ran */
+            addr.nl_groups = 1;
+            if (bind(monitor_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+                close(monitor_fd_);
+                monitor_fd_ = -1;
+            }
+        }
+        refresh();
+    }
+
+    ~SerialRegistry() {
+        if (monitor_fd_ >= 0)
+            close(monitor_fd_);
+    }
+
+    SerialRegistry(const SerialRegistry&) = delete;
+    SerialRegistry& operator=(const SerialRegistry&) = delete;
 
     /**
-   * @brief Destructor of serial device to close the device
-   */
-    ~Serial() {
-        close_device();
+     * @brief Enumerate /sys/class/tty again, needed only when hotplug events are unavailable
+     */
+    void refresh() {
+        ports_.clear();
+        by_usb_id_.clear();
+        by_serial_number_.clear();
+        std::error_code ec;
+        for (const auto& dir_entry : std::filesystem::directory_iterator("/sys/class/tty", ec)) {
+            std::string name = dir_entry.path().filename().string();
+            if (SerialInfo::is_serial_name(name) && std::filesystem::exists(dir_entry.path() / "device", ec))
+                insert(SerialInfo::get_info("/dev/" + name));
+        }
     }
 
     /**
-   * @brief Initialization of serial device to config and open the device
-   * @return True if success
-   */
-    bool init() {
-        if (port_name_.c_str() == nullptr)
-            return false;
-        if (open_device() && config_device()) {
-            FD_ZERO(&serial_fd_set_);
-            FD_SET(serial_fd_, &serial_fd_set_);
+     * @brief Apply pending hotplug events without blocking
+     * @return Number of devices added or removed
+     */
+    size_t process_events() {
+        size_t changes = 0;
+        char buf[8192];
+        while (monitor_fd_ >= 0) {
+            ssize_t n = recv(monitor_fd_, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                /* ENOBUFS means events were lost, enumerate again to resynchronize */
+                if (n < 0 && errno == ENOBUFS) {
+                    refresh();
+                    continue;
+                }
+                break;
+            }
+            changes += handle_event(buf, n);
+        }
+        return changes;
+    }
+
+    /**
+     * @brief Get the netlink socket, readable when hotplug events are pending
+     * @return File descriptor, -1 if hotplug events are unavailable
+     */
+    int native_handle() const {
+        return monitor_fd_;
+    }
+
+    /**
+     * @brief Register a callback invoked by process_events() for each added or removed device
+     */
+    void on_change(ChangeCallback callback) {
+        callback_ = std::move(callback);
+    }
+
+    /**
+     * @brief Find a device by name
+     * @param port_name Device name, i.e. ttyUSB0
+     * @return Device info, nullptr if not present
+     */
+    const SerialInfo *find(const std::string& port_name) const {
+        auto it = ports_.find(port_name);
+        return it == ports_.end() ? nullptr : &it->second;
+    }
+
+    /**
+     * @brief Find the device with a USB vendor and product id whose port name sorts first
+     * @return Device info, nullptr if not present
+     * @note Port names compare as strings, so ttyUSB10 comes before ttyUSB2
+     */
+    const SerialInfo *find(unsigned short vendor_id, unsigned short product_id) const {
+        auto range = by_usb_id_.equal_range(usb_id(vendor_id, product_id));
+        const std::string *first = nullptr;
+        for (auto it = range.first; it != range.second; ++it) {
+            if (first == nullptr || it->second < *first)
+                first = &it->second;
+        }
+        return first == nullptr ? nullptr : find(*first);
+    }
+
+    /**
+     * @brief Find a device by its USB serial number
+     * @return Device info, nullptr if not present
+     */
+    const SerialInfo *find_serial_number(const std::string& serial_number) const {
+        auto it = by_serial_number_.find(serial_number);
+        return it == by_serial_number_.end() ? nullptr : find(it->second);
+    }
+
+    /**
+     * @brief List all cached devices
+     * @return Serial device info
+     */
+    std::vector<SerialInfo> list_port() const {
+        std::vector<SerialInfo> serial_info_list;
+        serial_info_list.reserve(ports_.size());
+        for (const auto& port : ports_)
+            serial_info_list.push_back(port.second);
+        return serial_info_list;
+    }
+
+    //! number of cached devices
+    size_t size() const {
+        return ports_.size();
+    }
+
+private:
+    static uint32_t usb_id(unsigned short vendor_id, unsigned short product_id) {
+        return (uint32_t)vendor_id << 16 | product_id;
+    }
+
+    void insert(SerialInfo info) {
+        std::string name = info.port_name;
+        erase(name);
+        if (info.vendor_id || info.product_id)
+            by_usb_id_.emplace(usb_id(info.vendor_id, info.product_id), name);
+        if (!info.serial_number.empty())
+            by_serial_number_[info.serial_number] = name;
+        ports_[name] = std::move(info);
+    }
+
+    void erase(const std::string& port_name) {
+        auto it = ports_.find(port_name);
+        if (it == ports_.end())
+            return;
+        auto range = by_usb_id_.equal_range(usb_id(it->second.vendor_id, it->second.product_id));
+        for (auto id = range.first; id != range.second; ++id) {
+            if (id->second == port_name) {
+                by_usb_id_.erase(id);
+                break;
+            }
+        }
+        auto serial = by_serial_number_.find(it->second.serial_number);
+        if (serial != by_serial_number_.end() && serial->second == port_name)
+            by_serial_number_.erase(serial);
+        ports_.erase(it);
+    }
+
+    /**
+     * @brief Parse one uevent, "action@devpath" followed by NUL separated KEY=value pairs
+     * @return 1 if a device was added or removed, else 0
+     */
+    size_t handle_event(const char *buf, size_t len) {
+        std::string_view action, subsystem, devname;
+        for (size_t i = 0; i < len;) {
+            std::string_view field(buf + i, strnlen(buf + i, len - i));
+            if (field.compare(0, 7, "ACTION=") == 0)
+                action = field.substr(7);
+            else if (field.compare(0, 10, "SUBSYSTEM=") == 0)
+                subsystem = field.substr(10);
+            else if (field.compare(0, 8, "DEVNAME=") == 0)
+                devname = field.substr(8);
+            i += field.size() + 1;
+        }
+        if (subsystem != "tty" || devname.empty())
+            return 0;
+        /* DEVNAME is relative to /dev, i.e. ttyUSB0 */
+        std::string name(devname.substr(devname.rfind('/') + 1));
+        if (!SerialInfo::is_serial_name(name))
+            return 0;
+        if (action == "add") {
+            insert(SerialInfo::get_info("/dev/" + name));
+            if (callback_)
+                callback_(ports_[name], true);
+            return 1;
+        }
+        if (action == "remove") {
+            auto it = ports_.find(name);
+            if (it == ports_.end())
+                return 0;
+            SerialInfo info = it->second;
+            erase(name);
+            if (callback_)
+                callback_(info, false);
+            return 1;
+        }
+        return 0;
+    }
+
+    //! NETLINK_KOBJECT_UEVENT socket, -1 if unavailable
+    int monitor_fd_;
+    //! devices indexed by name
+    std::unordered_map<std::string, SerialInfo> ports_;
+    //! device names indexed by vendor_id << 16 | product_id
+    std::unordered_multimap<uint32_t, std::string> by_usb_id_;
+    //! device names indexed by USB serial number
+    std::unordered_map<std::string, std::string> by_serial_number_;
+    ChangeCallback callback_;
+};
+
+/**
+ * @brief Byte scanning kernels used by the frame decoders, selected at runtime by CPU features
+ */
+namespace simd {
+
+//! SLIP special bytes (RFC 1055)
+constexpr uint8_t slip_end = 0xC0;
+constexpr uint8_t slip_esc = 0xDB;
+constexpr uint8_t slip_esc_end = 0xDC;
+constexpr uint8_t slip_esc_esc = 0xDD;
+
+namespace scalar {
+
+/**
+ * @brief Find the first byte equal to a or b
+ * @return Index of the byte, len if not found
+ */
+inline size_t find_either(const uint8_t *data, size_t len, uint8_t a, uint8_t b) {
+    for (size_t i = 0; i < len; ++i) {
+        if (data[i] == a || data[i] == b)
+            return i;
+    }
+    return len;
+}
+
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+namespace sse2 {
+
+__attribute__((target("sse2")))
+inline size_t find_either(const uint8_t *data, size_t len, uint8_t a, uint8_t b) {
+    const __m128i va = _mm_set1_epi8((char)a);
+    const __m128i vb = _mm_set1_epi8((char)b);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + scalar::find_either(data + i, len - i, a, b);
+}
+
+}
+
+namespace avx2 {
+
+__attribute__((target("avx2")))
+inline size_t find_either(const uint8_t *data, size_t len, uint8_t a, uint8_t b) {
+    const __m256i va = _mm256_set1_epi8((char)a);
+    const __m256i vb = _mm256_set1_epi8((char)b);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + sse2::find_either(data + i, len - i, a, b);
+}
+
+}
+#endif
+
+#if defined(__aarch64__)
+namespace neon {
+
+inline size_t find_either(const uint8_t *data, size_t len, uint8_t a, uint8_t b) {
+    const uint8x16_t va = vdupq_n_u8(a);
+    const uint8x16_t vb = vdupq_n_u8(b);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(data + i);
+        uint8x16_t eq = vorrq_u8(vceqq_u8(v, va), vceqq_u8(v, vb));
+        /* narrow each byte to a nibble, giving a 64 bit mask */
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if (mask)
+            return i + (__builtin_ctzll(mask) >> 2);
+    }
+    return i + scalar::find_either(data + i, len - i, a, b);
+}
+
+}
+#endif
+
+/**
+ * @brief Kernel table, chosen once for the running CPU unless switched by use_kernels()
+ */
+struct Kernels {
+    const char *name;
+    size_t (*find_either)(const uint8_t *, size_t, uint8_t, uint8_t);
+};
+
+/**
+ * @brief Get the kernel tables usable on the running CPU
+ * @return Tables ordered from the fastest to scalar, the first one is used by default
+ */
+inline const std::vector<Kernels>& available_kernels() {
+    static const std::vector<Kernels> available = [] {
+        std::vector<Kernels> k;
+#if defined(SERIAL_LITE_NO_SIMD)
+#elif defined(__x86_64__) || defined(__i386__)
+        if (__builtin_cpu_supports("avx2"))
+            k.push_back(Kernels{"avx2", avx2::find_either});
+        if (__builtin_cpu_supports("sse2"))
+            k.push_back(Kernels{"sse2", sse2::find_either});
+#elif defined(__aarch64__)
+        k.push_back(Kernels{"neon", neon::find_either});
+#endif
+        k.push_back(Kernels{"scalar", scalar::find_either});
+        return k;
+    }();
+    return available;
+}
+
+inline Kernels& selected_kernels() {
+    static Kernels selected = available_kernels().front();
+    return selected;
+}
+
+inline const Kernels& kernels() {
+    return selected_kernels();
+}
+
+/**
+ * @brief Switch all decoders to another kernel table, i.e. to compare the kernels
+ * @param name Name of one of the available_kernels()
+ * @return False if no such table is available
+ * @note Not synchronized with decoders running on other threads
+ */
+inline bool use_kernels(std::string_view name) {
+    for (const Kernels& k : available_kernels()) {
+        if (name == k.name) {
+            selected_kernels() = k;
             return true;
-        } else {
-            close_device();
-            return false;
         }
     }
+    return false;
+}
 
-    long long wait_readable(long long nanosecond) {
-        // Setup a select call to block for serial data or a timeout
-        FD_ZERO(&serial_fd_set_);
-        FD_SET(serial_fd_, &serial_fd_set_);
+/**
+ * @brief Find the first byte equal to c
+ * @return Index of the byte, len if not found
+ */
+inline size_t find_byte(const uint8_t *data, size_t len, uint8_t c) {
+    return kernels().find_either(data, len, c, c);
+}
 
-        timespec timeout_ts;
-        timeout_ts.tv_sec = nanosecond / (long long)1e9;
-        timeout_ts.tv_nsec = nanosecond % (long long)1e9;
+/**
+ * @brief Find the first byte equal to a or b
+ * @return Index of the byte, len if not found
+ */
+inline size_t find_either(const uint8_t *data, size_t len, uint8_t a, uint8_t b) {
+    return kernels().find_either(data, len, a, b);
+}
 
-        int r = pselect(serial_fd_ + 1, &serial_fd_set_, NULL, NULL, &timeout_ts, NULL);
+/**
+ * @brief SLIP escape a payload, the END delimiters are not added
+ * @param src Payload to be escaped
+ * @param len Payload length
+ * @param dst Output buffer of at least 2 * len bytes
+ * @return Escaped length
+ */
+inline size_t slip_escape(const uint8_t *src, size_t len, uint8_t *dst) {
+    size_t r = 0, w = 0;
+    while (r < len) {
+        size_t n = find_either(src + r, len - r, slip_end, slip_esc);
+        memcpy(dst + w, src + r, n);
+        r += n;
+        w += n;
+        if (r < len) {
+            dst[w++] = slip_esc;
+            dst[w++] = src[r++] == slip_end ? slip_esc_end : slip_esc_esc;
+        }
+    }
+    return w;
+}
 
-        if (r <= 0)
-            return -1;
-        
-        // Get avaliable bytes
-        ioctl(serial_fd_, FIONREAD, &r);
+/**
+ * @brief SLIP unescape a payload in place
+ * @param data Escaped payload without END delimiters
+ * @param len Updated with the unescaped length
+ * @return True if the escape sequences are valid
+ */
+inline bool slip_unescape(uint8_t *data, size_t& len) {
+    size_t r = find_byte(data, len, slip_esc);
+    size_t w = r;
+    while (r < len) {
+        if (r + 1 == len)
+            return false;
+        if (data[r + 1] == slip_esc_end)
+            data[w++] = slip_end;
+        else if (data[r + 1] == slip_esc_esc)
+            data[w++] = slip_esc;
+        else
+            return false;
+        r += 2;
+        size_t n = find_byte(data + r, len - r, slip_esc);
+        memmove(data + w, data + r, n);
+        r += n;
+        w += n;
+    }
+    len = w;
+    return true;
+}
 
-        return r;
+}
+
+//! assumed cache line size, keeps producer and consumer state on separate lines
+constexpr size_t cache_line_size = 64;
+
+/**
+ * @brief Lock-free single-producer/single-consumer ring buffer
+ * @tparam T trivially copyable element type
+ */
+template <typename T>
+class SpscRing {
+public:
+    /**
+   * @brief Constructor of ring buffer, the storage is allocated once here
+   * @param capacity minimum number of elements, rounded up to a power of two
+   */
+    explicit SpscRing(size_t capacity) : mask_(round_up(capacity) - 1),
+                                         data_(new T[mask_ + 1]) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    bool empty() const {
+        return size() == 0;
     }
 
     /**
-   * @brief Serial device read function
-   * @param buf Given buffer to be updated by reading
-   * @param len Read data length
-   * @return -1 if failed, else the read length
+   * @brief Get the contiguous free region, producer side
+   * @param len Updated with the number of writable elements
+   * @return Pointer to the region, nullptr if the ring is full
    */
-    long long read(uint8_t *buf, size_t len) {
-        if (nullptr == buf) {
-            return -1;
-        } else {
-            return ::read(serial_fd_, buf, len);;
-        }
+    T *write_region(size_t& len) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ == capacity())
+            head_cache_ = head_.load(std::memory_order_acquire);
+        size_t offset = tail & mask_;
+        len = std::min(capacity() - (tail - head_cache_), capacity() - offset);
+        return len ? data_.get() + offset : nullptr;
     }
 
     /**
-   * @brief Write the buffer data into device to send the data
-   * @param buf Given buffer to be sent
-   * @param len Send data length
-   * @return < 0 if failed, else the send length
+   * @brief Publish elements written into the free region
+   * @param len Number of elements written
    */
-    long long write(const uint8_t *buf, size_t len) const {
-        return ::write(serial_fd_, buf, len);
+    void commit_write(size_t len) {
+        tail_.store(tail_.load(std::memory_order_relaxed) + len, std::memory_order_release);
     }
 
-private:
     /**
-   * @brief Open the serial device
-   * @return True if open successfully
+   * @brief Get the contiguous filled region, consumer side
+   * @param len Updated with the number of readable elements
+   * @return Pointer to the region, nullptr if the ring is empty
    */
-    bool open_device() {
-        serial_fd_ = open(port_name_.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
-        if (serial_fd_ < 0)
-            return false;
-        return true;
+    const T *read_region(size_t& len) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (tail_cache_ == head)
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+        size_t offset = head & mask_;
+        len = std::min(tail_cache_ - head, capacity() - offset);
+        return len ? data_.get() + offset : nullptr;
     }
 
     /**
-   * @brief Close the serial device
-   * @return True if close successfully
+   * @brief Release elements consumed from the filled region
+   * @param len Number of elements consumed
    */
-    bool close_device() {
-        if (serial_fd_ >= 0)
-            tcsetattr(serial_fd_, TCSANOW, &old_termios_);
-        close(serial_fd_);
-        serial_fd_ = -1;
-        return true;
+    void commit_read(size_t len) {
+        head_.store(head_.load(std::memory_order_relaxed) + len, std::memory_order_release);
     }
 
     /**
-   * @brief Configure the device
-   * @return True if configure successfully
+   * @brief Copy elements into the ring, producer side
+   * @param src Elements to be copied
+   * @param n Number of elements
+   * @return Number of elements actually copied
    */
-    bool config_device() {
-        int st_baud[] = {B4800, B9600, B19200, B38400,
-                         B57600, B115200, B230400, B921600};
-        int std_rate[] = {4800, 9600, 19200, 38400, 57600, 115200,
-                          230400, 921600, 1000000, 1152000, 3000000};
-        int i, j;
-        /* save current port parameter */
-        if (tcgetattr(serial_fd_, &old_termios_) != 0) {
-            return false;
+    size_t push(const T *src, size_t n) {
+        size_t done = 0;
+        size_t len;
+        T *region;
+        while (done < n && (region = write_region(len)) != nullptr) {
+            len = std::min(len, n - done);
+            std::copy(src + done, src + done + len, region);
+            commit_write(len);
+            done += len;
         }
-        memset(&new_termios_, 0, sizeof(new_termios_));
-        /* config the size of char */
-        new_termios_.c_cflag |= CLOCAL | CREAD;
-        new_termios_.c_cflag &= ~CSIZE;
-        /* config data bit */
-        switch (data_bits_) {
-            case 7:
-                new_termios_.c_cflag |= CS7;
-                break;
-            case 8:
-                new_termios_.c_cflag |= CS8;
+        return done;
+    }
+
+    /**
+   * @brief Copy elements out of the ring, consumer side
+   * @param dst Given buffer to be updated
+   * @param n Maximum number of elements
+   * @return Number of elements actually copied
+   */
+    size_t pop(T *dst, size_t n) {
+        size_t done = 0;
+        size_t len;
+        const T *region;
+        while (done < n && (region = read_region(len)) != nullptr) {
+            len = std::min(len, n - done);
+            std::copy(region, region + len, dst + done);
+            commit_read(len);
+            done += len;
+        }
+        return done;
+    }
+
+private:
+    static size_t round_up(size_t n) {
+        size_t capacity = 1;
+        while (capacity < n)
+            capacity <<= 1;
+        return capacity;
+    }
+
+    //! consumer index and the consumer's view of the producer index
+    alignas(cache_line_size) std::atomic<size_t> head_{0};
+    size_t tail_cache_{0};
+    //! producer index and the producer's view of the consumer index
+    alignas(cache_line_size) std::atomic<size_t> tail_{0};
+    size_t head_cache_{0};
+    //! read-only after construction
+    alignas(cache_line_size) const size_t mask_;
+    std::unique_ptr<T[]> data_;
+};
+
+/**
+ * @brief How Serial::read waits for data
+ */
+struct ReadPolicy {
+    //! clear O_NONBLOCK so that VMIN and VTIME apply
+    bool blocking;
+    //! minimum number of bytes a blocking read waits for
+    cc_t vmin;
+    //! inter-byte timeout of a blocking read, in deciseconds
+    cc_t vtime;
+    //! nanoseconds a non-blocking read waits for the first byte, negative to return at once
+    long long timeout;
+
+    /**
+   * @brief Return at once with the available bytes, -1 with EAGAIN if there are none
+   */
+    static constexpr ReadPolicy non_blocking() {
+        return ReadPolicy{false, 1, 0, -1};
+    }
+
+    /**
+   * @brief Block until at least n bytes have been received, i.e. 64 for bulk telemetry
+   */
+    static constexpr ReadPolicy min_bytes(cc_t n) {
+        return ReadPolicy{true, n, 0, -1};
+    }
+
+    /**
+   * @brief Block for the first byte, then return once n bytes arrived or the line was idle
+   * @param n minimum number of bytes, 0 to make the idle timer start at once
+   * @param deciseconds inter-byte timeout
+   */
+    static constexpr ReadPolicy inter_byte_timeout(cc_t n, cc_t deciseconds) {
+        return ReadPolicy{true, n, deciseconds, -1};
+    }
+
+    /**
+   * @brief Wait up to nanosecond for the first byte, then return the available bytes, 0 on timeout
+   */
+    static constexpr ReadPolicy total_deadline(long long nanosecond) {
+        return ReadPolicy{false, 1, 0, nanosecond < 0 ? 0 : nanosecond};
+    }
+};
+
+/**
+ * @brief Look up the termios speed constant of a standard baudrate
+ * @param baudrate serial baudrate
+ * @return Speed constant, B0 if the baudrate has no constant
+ */
+constexpr speed_t standard_speed(int baudrate) {
+    const struct {
+        int rate;
+        speed_t speed;
+    } table[] = {
+        {4800, B4800}, {9600, B9600}, {19200, B19200}, {38400, B38400},
+        {57600, B57600}, {115200, B115200}, {230400, B230400},
+#ifdef B460800
+        {460800, B460800},
+#endif
+#ifdef B500000
+        {500000, B500000}, {576000, B576000},
+#endif
+#ifdef B921600
+        {921600, B921600},
+#endif
+#ifdef B1000000
+        {1000000, B1000000}, {1152000, B1152000}, {1500000, B1500000},
+        {2000000, B2000000}, {2500000, B2500000}, {3000000, B3000000},
+        {3500000, B3500000}, {4000000, B4000000},
+#endif
+    };
+    for (const auto& entry : table) {
+        if (entry.rate == baudrate)
+            return entry.speed;
+    }
+    return B0;
+}
+
+//! parity of a character, mark and space parity send a constant parity bit
+enum class Parity : char {
+    none = 'N',
+    odd = 'O',
+    even = 'E',
+    mark = 'M',
+    space = 'S'
+};
+
+enum class FlowControl {
+    none,
+    //! RTS/CTS handshake
+    hardware,
+    //! XON/XOFF characters
+    software
+};
+
+/**
+ * @brief Line settings of a serial device, built like SerialConfig().baud(19200).framing(8, Parity::even, 1)
+ */
+struct SerialConfig {
+    int baudrate{115200};
+    //! 5 to 8 data bits
+    int data_bits{8};
+    Parity parity{Parity::none};
+    //! 1 or 2 stop bits
+    int stop_bits{1};
+    FlowControl flow_control{FlowControl::none};
+    ReadPolicy read_policy{ReadPolicy::non_blocking()};
+    //! async mode receive ring size in bytes
+    size_t rx_buffer{65536};
+    //! async mode transmit ring size in bytes
+    size_t tx_buffer{65536};
+
+    constexpr SerialConfig baud(int rate) const {
+        SerialConfig config = *this;
+        config.baudrate = rate;
+        return config;
+    }
+
+    constexpr SerialConfig framing(int data, Parity parity_bit, int stop) const {
+        SerialConfig config = *this;
+        config.data_bits = data;
+        config.parity = parity_bit;
+        config.stop_bits = stop;
+        return config;
+    }
+
+    constexpr SerialConfig flow(FlowControl control) const {
+        SerialConfig config = *this;
+        config.flow_control = control;
+        return config;
+    }
+
+    constexpr SerialConfig policy(const ReadPolicy& read) const {
+        SerialConfig config = *this;
+        config.read_policy = read;
+        return config;
+    }
+
+    constexpr SerialConfig buffers(size_t rx, size_t tx) const {
+        SerialConfig config = *this;
+        config.rx_buffer = rx;
+        config.tx_buffer = tx;
+        return config;
+    }
+
+    /**
+     * @brief Check the settings, constant evaluated for presets
+     * @return True if every field is in range and the baudrate can be set on this platform
+     */
+    constexpr bool valid() const {
+        bool rate = baudrate > 0;
+#ifndef SERIAL_LITE_HAS_TERMIOS2
+        rate = rate && standard_speed(baudrate) != B0;
+#endif
+        bool buffers_valid = rx_buffer > 0 && tx_buffer > 0 && rx_buffer <= ((size_t)1 << 30) &&
+                             tx_buffer <= ((size_t)1 << 30);
+        bool policy_valid = read_policy.blocking ? read_policy.timeout < 0 : read_policy.vmin <= 1 && read_policy.vtime == 0;
+        /* with 5 data bits, CSTOPB gives 1.5 stop bits instead of 2 */
+        bool framing_valid = data_bits >= 5 && data_bits <= 8 && (stop_bits == 1 || (stop_bits == 2 && data_bits > 5));
+        return rate && framing_valid &&
+               (parity == Parity::none || parity == Parity::odd || parity == Parity::even ||
+                parity == Parity::mark || parity == Parity::space) &&
+               (flow_control == FlowControl::none || flow_control == FlowControl::hardware ||
+                flow_control == FlowControl::software) &&
+               buffers_valid && policy_valid;
+    }
+
+    /**
+     * @brief Get the duration of one character: start bit, data bits, parity bit and stop bits
+     * @return Nanoseconds, 0 if the baudrate is not set
+     */
+    constexpr uint64_t char_time() const {
+        if (baudrate <= 0)
+            return 0;
+        int bits = 1 + data_bits + (parity != Parity::none) + stop_bits;
+        return (uint64_t)bits * 1000000000ull / baudrate;
+    }
+
+    /**
+     * @brief Build the raw mode termios of these settings
+     * @note Baudrates without a speed constant are left at B0 and applied through termios2
+     */
+    struct termios to_termios() const {
+        struct termios tio;
+        memset(&tio, 0, sizeof(tio));
+        tio.c_cflag = CLOCAL | CREAD;
+        static constexpr tcflag_t sizes[] = {CS5, CS6, CS7, CS8};
+        tio.c_cflag |= data_bits >= 5 && data_bits <= 8 ? sizes[data_bits - 5] : CS8;
+        switch (parity) {
+            case Parity::odd:
+                tio.c_cflag |= PARENB | PARODD;
                 break;
-            default:
-                new_termios_.c_cflag |= CS8;
-                break; //8N1 default config
-        }
-        /* config the parity bit */
-        switch (parity_bits_) {
-            /* odd */
-            case 'O':
-            case 'o':
-                new_termios_.c_cflag |= PARENB;
-                new_termios_.c_cflag |= PARODD;
+            case Parity::even:
+                tio.c_cflag |= PARENB;
                 break;
-                /* even */
-            case 'E':
-            case 'e':
-                new_termios_.c_cflag |= PARENB;
-                new_termios_.c_cflag &= ~PARODD;
+            case Parity::mark:
+                tio.c_cflag |= PARENB | CMSPAR | PARODD;
                 break;
-                /* none */
-            case 'N':
-            case 'n':
-                new_termios_.c_cflag &= ~PARENB;
+            case Parity::space:
+                tio.c_cflag |= PARENB | CMSPAR;
                 break;
             default:
-                new_termios_.c_cflag &= ~PARENB;
-                break; //8N1 default config
-        }
-        /* config baudrate */
-        j = sizeof(std_rate) / 4;
-        for (i = 0; i < j; ++i) {
-            if (std_rate[i] == baudrate_) {
-                /* set standard baudrate */
-                cfsetispeed(&new_termios_, st_baud[i]);
-                cfsetospeed(&new_termios_, st_baud[i]);
                 break;
+        }
+        if (stop_bits == 2)
+            tio.c_cflag |= CSTOPB;
+        if (flow_control == FlowControl::hardware) {
+            tio.c_cflag |= CRTSCTS;
+        } else if (flow_control == FlowControl::software) {
+            tio.c_iflag |= IXON | IXOFF;
+            tio.c_cc[VSTART] = 0x11;
+            tio.c_cc[VSTOP] = 0x13;
+        }
+        speed_t speed = standard_speed(baudrate);
+        if (speed != B0) {
+            cfsetispeed(&tio, speed);
+            cfsetospeed(&tio, speed);
+        }
+        tio.c_cc[VTIME] = read_policy.vtime;
+        tio.c_cc[VMIN] = read_policy.vmin;
+        return tio;
+    }
+};
+
+/**
+ * @brief Check a configuration at compile time
+ * @tparam Config configuration, an invalid one fails to compile
+ */
+template <SerialConfig Config>
+constexpr SerialConfig validated() {
+    static_assert(Config.valid(), "invalid serial configuration");
+    return Config;
+}
+
+/**
+ * @brief Common configurations, checked at compile time
+ */
+namespace preset {
+
+inline constexpr SerialConfig default_8n1 = validated<SerialConfig{}>();
+//! NMEA 0183 GPS receivers
+inline constexpr SerialConfig nmea = validated<SerialConfig().baud(4800)>();
+//! Modbus RTU, the specification demands even parity
+inline constexpr SerialConfig modbus_rtu = validated<SerialConfig().baud(19200).framing(8, Parity::even, 1)>();
+//! DMX512 lighting, 250 kbaud with 2 stop bits
+inline constexpr SerialConfig dmx512 = validated<SerialConfig().baud(250000).framing(8, Parity::none, 2)>();
+//! fast usb-serial bridges, which need RTS/CTS to not overrun
+inline constexpr SerialConfig high_speed =
+    validated<SerialConfig().baud(3000000).flow(FlowControl::hardware).buffers(1 << 20, 1 << 20)>();
+
+}
+
+/**
+ * @brief Modem control and status lines, bits of Serial::modem_lines()
+ */
+namespace modem {
+
+//! outputs
+constexpr int dtr = TIOCM_DTR;
+constexpr int rts = TIOCM_RTS;
+//! inputs
+constexpr int cts = TIOCM_CTS;
+constexpr int dsr = TIOCM_DSR;
+constexpr int dcd = TIOCM_CD;
+constexpr int ri = TIOCM_RI;
+
+}
+
+/**
+ * @brief RS-485 transceiver control of the driver
+ */
+struct Rs485Settings {
+    //! drive RTS as transmit enable
+    bool enabled{true};
+    //! RTS level while sending, the opposite level is used after sending
+    bool rts_on_send{true};
+    //! keep receiving while sending
+    bool rx_during_tx{false};
+    //! turnaround delay before sending in ms
+    unsigned delay_before_send{0};
+    //! turnaround delay after sending in ms
+    unsigned delay_after_send{0};
+};
+
+/**
+ * @brief Kernel side latency settings of a serial device
+ */
+struct LatencySettings {
+    //! ASYNC_LOW_LATENCY flag of the driver
+    bool low_latency{true};
+    //! latency timer of FTDI style usb-serial adapters in ms, -1 to leave it unchanged
+    int latency_timer{-1};
+    //! RS-485 mode, nullopt to leave it unchanged
+    std::optional<Rs485Settings> rs485;
+};
+
+/**
+ * @brief Latency settings which actually took effect, read back from the driver
+ */
+struct LatencyReport {
+    //! the driver supports TIOCGSERIAL/TIOCSSERIAL
+    bool low_latency_supported{false};
+    bool low_latency{false};
+    //! latency timer in ms, -1 if the adapter has none
+    int latency_timer{-1};
+    //! RS-485 mode, nullopt if the driver does not support it
+    std::optional<Rs485Settings> rs485;
+    //! every requested setting was applied as requested
+    bool complete{false};
+};
+
+/**
+ * @brief State of a bulk transfer, given to its progress callback
+ */
+struct TransferProgress {
+    //! bytes the driver accepted so far
+    size_t queued;
+    //! transfer length
+    size_t total;
+    //! true once all bytes left the transmitter, or were queued if no drain was requested
+    bool done;
+};
+
+/**
+ * @brief Outcome of a deadline bounded read
+ */
+struct ReadProgress {
+    //! bytes stored into the buffer
+    size_t count;
+    //! true if the read was fulfilled before the deadline
+    bool complete;
+    //! errno of the failure, 0 if completed or timed out
+    int error;
+
+    explicit operator bool() const {
+        return complete;
+    }
+};
+
+/**
+ * @brief Snapshot of a latency histogram
+ */
+struct HistogramSnapshot {
+    //! 8 linear sub-buckets per power of two, values are exact below 8 and within 12.5% above
+    static constexpr size_t sub_buckets = 8;
+    static constexpr size_t buckets = sub_buckets + 61 * sub_buckets;
+
+    static size_t bucket_of(uint64_t value) {
+        if (value < sub_buckets)
+            return value;
+        int msb = 63 - __builtin_clzll(value);
+        return sub_buckets + (msb - 3) * sub_buckets + ((value >> (msb - 3)) & (sub_buckets - 1));
+    }
+
+    //! largest value falling into a bucket
+    static uint64_t bucket_max(size_t bucket) {
+        if (bucket < sub_buckets)
+            return bucket;
+        int msb = (bucket - sub_buckets) / sub_buckets + 3;
+        uint64_t lower = (uint64_t)(sub_buckets + (bucket - sub_buckets) % sub_buckets) << (msb - 3);
+        return lower + ((uint64_t)1 << (msb - 3)) - 1;
+    }
+
+    /**
+     * @brief Get a percentile
+     * @param percent Percentile in [0, 100], i.e. 99.9
+     * @return Value at or below which percent of the samples fall, 0 if empty
+     */
+    uint64_t percentile(double percent) const {
+        if (count == 0)
+            return 0;
+        uint64_t rank = std::max<uint64_t>(1, (uint64_t)(percent / 100.0 * count + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets; ++i) {
+            seen += counts[i];
+            if (seen >= rank)
+                return std::min(bucket_max(i), max);
+        }
+        return max;
+    }
+
+    double mean() const {
+        return count ? (double)sum / count : 0.0;
+    }
+
+    std::array<uint64_t, buckets> counts{};
+    uint64_t count{0};
+    uint64_t sum{0};
+    uint64_t max{0};
+};
+
+/**
+ * @brief Log-linear latency histogram in the style of HdrHistogram, safe to record from any thread
+ */
+class LatencyHistogram {
+public:
+    void record(uint64_t value) {
+        counts_[HistogramSnapshot::bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * @brief Copy the counters, concurrent records may be partially included
+     */
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot snapshot;
+        for (size_t i = 0; i < HistogramSnapshot::buckets; ++i)
+            snapshot.counts[i] = counts_[i].load(std::memory_order_relaxed);
+        snapshot.count = count_.load(std::memory_order_relaxed);
+        snapshot.sum = sum_.load(std::memory_order_relaxed);
+        snapshot.max = max_.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    void reset() {
+        for (auto& count : counts_)
+            count.store(0, std::memory_order_relaxed);
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::buckets> counts_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+/**
+ * @brief Snapshot of the I/O statistics of a serial device
+ */
+struct SerialStats {
+    uint64_t rx_bytes{0};
+    uint64_t tx_bytes{0};
+    uint64_t read_calls{0};
+    uint64_t write_calls{0};
+    //! reads returning less than requested
+    uint64_t short_reads{0};
+    //! writes taking less than offered, the kernel buffer was full
+    uint64_t short_writes{0};
+    uint64_t read_eagain{0};
+    uint64_t write_eagain{0};
+    uint64_t read_errors{0};
+    uint64_t write_errors{0};
+    //! the driver supports TIOCGICOUNT, the cumulative driver counters below are valid
+    bool icount_supported{false};
+    //! receive FIFO overruns of the UART
+    uint64_t overrun{0};
+    //! receive buffer overruns of the tty layer
+    uint64_t buf_overrun{0};
+    uint64_t frame{0};
+    uint64_t parity{0};
+    uint64_t brk{0};
+    //! nanoseconds wait_readable() waited until data arrived
+    HistogramSnapshot wait_latency;
+    //! nanoseconds spent in write syscalls
+    HistogramSnapshot write_latency;
+};
+
+/**
+ * @brief Live I/O counters of a serial device, updated with relaxed atomics
+ */
+struct IoStats {
+    void record_read(size_t requested, ssize_t r) {
+        read_calls.fetch_add(1, std::memory_order_relaxed);
+        if (r > 0) {
+            rx_bytes.fetch_add(r, std::memory_order_relaxed);
+            if ((size_t)r < requested)
+                short_reads.fetch_add(1, std::memory_order_relaxed);
+        } else if (r < 0 && errno == EAGAIN) {
+            read_eagain.fetch_add(1, std::memory_order_relaxed);
+        } else if (r < 0 && errno != EINTR) {
+            read_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void record_write(size_t requested, ssize_t r, uint64_t nanosecond) {
+        write_calls.fetch_add(1, std::memory_order_relaxed);
+        write_latency.record(nanosecond);
+        if (r >= 0) {
+            tx_bytes.fetch_add(r, std::memory_order_relaxed);
+            if ((size_t)r < requested)
+                short_writes.fetch_add(1, std::memory_order_relaxed);
+        } else if (errno == EAGAIN) {
+            write_eagain.fetch_add(1, std::memory_order_relaxed);
+        } else if (errno != EINTR) {
+            write_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Copy the counters, TIOCGICOUNT is read from fd
+     */
+    SerialStats snapshot(int fd) const {
+        SerialStats stats;
+        stats.rx_bytes = rx_bytes.load(std::memory_order_relaxed);
+        stats.tx_bytes = tx_bytes.load(std::memory_order_relaxed);
+        stats.read_calls = read_calls.load(std::memory_order_relaxed);
+        stats.write_calls = write_calls.load(std::memory_order_relaxed);
+        stats.short_reads = short_reads.load(std::memory_order_relaxed);
+        stats.short_writes = short_writes.load(std::memory_order_relaxed);
+        stats.read_eagain = read_eagain.load(std::memory_order_relaxed);
+        stats.write_eagain = write_eagain.load(std::memory_order_relaxed);
+        stats.read_errors = read_errors.load(std::memory_order_relaxed);
+        stats.write_errors = write_errors.load(std::memory_order_relaxed);
+        struct serial_icounter_struct icount{};
+        if (fd >= 0 && ioctl(fd, TIOCGICOUNT, &icount) == 0) {
+            stats.icount_supported = true;
+            stats.overrun = icount.overrun;
+            stats.buf_overrun = icount.buf_overrun;
+            stats.frame = icount.frame;
+            stats.parity = icount.parity;
+            stats.brk = icount.brk;
+        }
+        stats.wait_latency = wait_latency.snapshot();
+        stats.write_latency = write_latency.snapshot();
+        return stats;
+    }
+
+    void reset() {
+        for (auto *counter : {&rx_bytes, &tx_bytes, &read_calls, &write_calls, &short_reads, &short_writes,
+                              &read_eagain, &write_eagain, &read_errors, &write_errors})
+            counter->store(0, std::memory_order_relaxed);
+        wait_latency.reset();
+        write_latency.reset();
+    }
+
+    std::atomic<uint64_t> rx_bytes{0};
+    std::atomic<uint64_t> tx_bytes{0};
+    std::atomic<uint64_t> read_calls{0};
+    std::atomic<uint64_t> write_calls{0};
+    std::atomic<uint64_t> short_reads{0};
+    std::atomic<uint64_t> short_writes{0};
+    std::atomic<uint64_t> read_eagain{0};
+    std::atomic<uint64_t> write_eagain{0};
+    std::atomic<uint64_t> read_errors{0};
+    std::atomic<uint64_t> write_errors{0};
+    LatencyHistogram wait_latency;
+    LatencyHistogram write_latency;
+};
+
+/**
+ * @brief Lazily started coroutine, co_await it or hand it to EventLoop::spawn
+ * @tparam T result type
+ */
+template <typename T = void>
+class Task;
+
+template <typename T>
+struct TaskPromiseBase {
+    struct FinalAwaiter {
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            auto& promise = handle.promise();
+            if (promise.detached) {
+                handle.destroy();
+                return std::noop_coroutine();
             }
+            return promise.continuation ? promise.continuation : std::noop_coroutine();
         }
-        /* config stop bit */
-        if (stop_bits_ == 1)
-            new_termios_.c_cflag &= ~CSTOPB;
-        else if (stop_bits_ == 2)
-            new_termios_.c_cflag |= CSTOPB;
-        else
-            new_termios_.c_cflag &= ~CSTOPB; //8N1 default config
-        /* config waiting time & min number of char */
-        new_termios_.c_cc[VTIME] = 10;      // Wait for up to 1s (10 deciseconds)
-        new_termios_.c_cc[VMIN] = 1;        // Returning as soon as any data is received
-        /* using the raw data mode */
-        new_termios_.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
-        new_termios_.c_oflag &= ~OPOST;
-        /* flush the hardware fifo */
-        tcflush(serial_fd_, TCIFLUSH);
-        /* activite the configuration */
-        if ((tcsetattr(serial_fd_, TCSANOW, &new_termios_)) != 0)
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() const noexcept {
+        return {};
+    }
+
+    void unhandled_exception() {
+        if (detached)
+            std::terminate();
+        exception = std::current_exception();
+    }
+
+    //! coroutine awaiting this task
+    std::coroutine_handle<> continuation;
+    //! owned by nobody, the frame destroys itself when done
+    bool detached{false};
+    std::exception_ptr exception;
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase<T> {
+    Task<T> get_return_object();
+
+    void return_value(T result) {
+        value.emplace(std::move(result));
+    }
+
+    T result() {
+        if (this->exception)
+            std::rethrow_exception(this->exception);
+        return std::move(*value);
+    }
+
+    std::optional<T> value;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase<void> {
+    Task<void> get_return_object();
+
+    void return_void() const {}
+
+    void result() const {
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+};
+
+template <typename T>
+class Task {
+public:
+    using promise_type = TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_)
+                handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    bool await_ready() const noexcept {
+        return !handle_ || handle_.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+        handle_.promise().continuation = continuation;
+        return handle_;
+    }
+
+    T await_resume() {
+        return handle_.promise().result();
+    }
+
+    /**
+   * @brief Start the task without an owner, its frame is freed when it finishes
+   */
+    void detach() {
+        if (!handle_)
+            return;
+        handle_.promise().detached = true;
+        std::exchange(handle_, nullptr).resume();
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+/**
+ * @brief Single threaded epoll loop resuming coroutines suspended on fd readiness
+ */
+class EventLoop {
+public:
+    /**
+   * @brief Pending I/O of a suspended coroutine, lives in the coroutine frame
+   */
+    struct Operation {
+        //! retry the I/O after a readiness event, true once it completed
+        bool (*perform)(Operation *);
+        //! coroutine to be resumed on completion
+        std::coroutine_handle<> handle;
+    };
+
+    /**
+   * @brief Constructor of event loop
+   * @param max_events maximum number of events dispatched per epoll_wait call
+   */
+    explicit EventLoop(size_t max_events = 256) : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+                                                  wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+                                                  events_(max_events ? max_events : 1) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = wake_fd_;
+        if (epoll_fd_ >= 0 && wake_fd_ >= 0)
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+    }
+
+    ~EventLoop() {
+        if (epoll_fd_ >= 0)
+            close(epoll_fd_);
+        if (wake_fd_ >= 0)
+            close(wake_fd_);
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    /**
+   * @brief Start a task on this thread, it runs until its first suspension
+   */
+    void spawn(Task<void> task) {
+        task.detach();
+    }
+
+    /**
+   * @brief Suspend an operation until its fd becomes ready, one reader and one writer per fd
+   * @param fd Non-blocking file descriptor
+   * @param write True to wait for EPOLLOUT, else EPOLLIN
+   * @param op Operation to be retried
+   * @return False if the fd could not be watched or already has a waiter
+   */
+    bool watch(int fd, bool write, Operation *op) {
+        if (fd < 0 || epoll_fd_ < 0)
             return false;
-        /* low latency mode */
-        struct serial_struct kernel_serial_settings;
-        ioctl(serial_fd_, TIOCGSERIAL, &kernel_serial_settings);
-        kernel_serial_settings.flags |= ASYNC_LOW_LATENCY;
-        ioctl(serial_fd_, TIOCSSERIAL, &kernel_serial_settings);
+        if ((size_t)fd >= watches_.size())
+            watches_.resize(fd + 1);
+        FdWatch& w = watches_[fd];
+        if (!w.registered) {
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.fd = fd;
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0 && errno != EEXIST)
+                return false;
+            w.registered = true;
+        }
+        Operation *&slot = write ? w.writer : w.reader;
+        if (slot != nullptr)
+            return false;
+        slot = op;
+        ++pending_;
         return true;
     }
 
-    //! port name of the serial device
-    std::string port_name_;
-    //! baudrate of the serial device
-    int baudrate_;
-    //! stop bits of the serial device, as default
-    int stop_bits_;
-    //! data bits of the serial device, as default
-    int data_bits_;
-    //! parity bits of the serial device, as default
-    char parity_bits_;
-    //! serial handler
-    int serial_fd_;
-    //! set flag of serial handler
-    fd_set serial_fd_set_;
-    //! termios config for serial handler
-    struct termios new_termios_, old_termios_;
+    /**
+   * @brief Forget an fd before it is closed, its pending operations are never resumed
+   */
+    void remove(int fd) {
+        if (fd < 0 || (size_t)fd >= watches_.size() || !watches_[fd].registered)
+            return;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        pending_ -= (watches_[fd].reader != nullptr) + (watches_[fd].writer != nullptr);
+        watches_[fd] = FdWatch();
+    }
+
+    /**
+   * @brief Wait for readiness once and resume the coroutines whose I/O completed
+   * @param nanosecond Timeout in nanosecond, negative to wait forever
+   * @return -1 if failed, else the number of resumed coroutines
+   */
+    int run_once(long long nanosecond) {
+        int timeout_ms = nanosecond < 0 ? -1 : (int)std::min<long long>((nanosecond + 999999) / 1000000, INT_MAX);
+        int n = epoll_wait(epoll_fd_, events_.data(), (int)events_.size(), timeout_ms);
+        if (n < 0)
+            return errno == EINTR ? 0 : -1;
+        int resumed = 0;
+        for (int i = 0; i < n; ++i) {
+            int fd = events_[i].data.fd;
+            uint32_t events = events_[i].events;
+            if (fd == wake_fd_) {
+                uint64_t count;
+                (void)::read(wake_fd_, &count, sizeof(count));
+                continue;
+            }
+            if ((size_t)fd >= watches_.size())
+                continue;
+            if (events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+                resumed += dispatch(fd, false);
+            if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                resumed += dispatch(fd, true);
+        }
+        return resumed;
+    }
+
+    /**
+   * @brief Run until stop() is called
+   */
+    void run() {
+        stopped_.store(false, std::memory_order_relaxed);
+        while (!stopped_.load(std::memory_order_acquire) && run_once(-1) >= 0) {
+        }
+    }
+
+    /**
+   * @brief Make run() return, can be called from any thread
+   */
+    void stop() {
+        stopped_.store(true, std::memory_order_release);
+        uint64_t one = 1;
+        (void)::write(wake_fd_, &one, sizeof(one));
+    }
+
+    //! number of suspended operations
+    size_t pending() const {
+        return pending_;
+    }
+
+private:
+    struct FdWatch {
+        Operation *reader{nullptr};
+        Operation *writer{nullptr};
+        bool registered{false};
+    };
+
+    int dispatch(int fd, bool write) {
+        Operation *op = write ? watches_[fd].writer : watches_[fd].reader;
+        if (op == nullptr || !op->perform(op))
+            return 0;
+        (write ? watches_[fd].writer : watches_[fd].reader) = nullptr;
+        --pending_;
+        op->handle.resume();
+        return 1;
+    }
+
+    //! epoll handler shared by all watched fds
+    int epoll_fd_;
+    //! eventfd interrupting epoll_wait for stop()
+    int wake_fd_;
+    //! preallocated event batch
+    std::vector<epoll_event> events_;
+    //! waiters indexed by fd
+    std::vector<FdWatch> watches_;
+    size_t pending_{0};
+    std::atomic<bool> stopped_{false};
+};
+
+/**
+ * @brief Byte stream a protocol stack runs on, implemented by Serial, ReplaySerial, MemoryPipe and TcpTransport
+ */
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    /**
+   * @brief Read the available bytes
+   * @param buf Given buffer to be updated by reading
+   * @param len Read data length
+   * @return -1 if failed or with EAGAIN if nothing is available, else the read length
+   */
+    virtual long long read(uint8_t *buf, size_t len) = 0;
+
+    /**
+   * @brief Send bytes
+   * @param buf Given buffer to be sent
+   * @param len Send data length
+   * @return < 0 if failed, else the send length
+   */
+    virtual long long write(const uint8_t *buf, size_t len) = 0;
+
+    /**
+   * @brief Wait until data can be read
+   * @param nanosecond Timeout in nanosecond
+   * @return -1 if timeout or failed, else the available bytes
+   */
+    virtual long long wait_readable(long long nanosecond) = 0;
+
+    /**
+   * @brief Get the file descriptor for epoll and event loops
+   * @return -1 if the transport has none
+   */
+    virtual int native_handle() const = 0;
+};
+
+/**
+ * @brief Two connected in-memory endpoints over lock-free rings, one thread may drive each endpoint
+ */
+class MemoryPipe {
+    //! one direction of the pipe, the reader sleeps on the condition variable while it is empty
+    struct Channel {
+        explicit Channel(size_t capacity) : ring(capacity) {}
+
+        SpscRing<uint8_t> ring;
+        //! set while the reader waits, the writer only takes the mutex then
+        std::atomic<bool> waiting{false};
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+public:
+    class Endpoint final : public Transport {
+    public:
+        Endpoint(Channel& rx, Channel& tx) : rx_(rx), tx_(tx) {}
+
+        long long read(uint8_t *buf, size_t len) override {
+            if (nullptr == buf)
+                return -1;
+            size_t n = rx_.ring.pop(buf, len);
+            if (n == 0 && len > 0) {
+                errno = EAGAIN;
+                return -1;
+            }
+            return n;
+        }
+
+        long long write(const uint8_t *buf, size_t len) override {
+            if (nullptr == buf)
+                return -1;
+            size_t n = tx_.ring.push(buf, len);
+            if (n == 0 && len > 0) {
+                errno = EAGAIN;
+                return -1;
+            }
+            /* pairs with the fence of a reader going to sleep, one of both sees the other */
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (tx_.waiting.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(tx_.mutex);
+                tx_.cv.notify_one();
+            }
+            return n;
+        }
+
+        /**
+       * @brief Sleep until the peer wrote data, the writer wakes the reader
+       */
+        long long wait_readable(long long nanosecond) override {
+            if (!rx_.ring.empty())
+                return rx_.ring.size();
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(nanosecond);
+            std::unique_lock<std::mutex> lock(rx_.mutex);
+            rx_.waiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool ready = rx_.cv.wait_until(lock, deadline, [this] { return !rx_.ring.empty(); });
+            rx_.waiting.store(false, std::memory_order_relaxed);
+            return ready ? (long long)rx_.ring.size() : -1;
+        }
+
+        int native_handle() const override {
+            return -1;
+        }
+
+    private:
+        Channel& rx_;
+        Channel& tx_;
+    };
+
+    /**
+   * @brief Constructor of memory pipe, both rings are allocated once here
+   * @param capacity bytes buffered per direction
+   */
+    explicit MemoryPipe(size_t capacity = 1 << 20) : a_to_b_(capacity), b_to_a_(capacity),
+                                                  a_(b_to_a_, a_to_b_), b_(a_to_b_, b_to_a_) {}
+
+    MemoryPipe(const MemoryPipe&) = delete;
+    MemoryPipe& operator=(const MemoryPipe&) = delete;
+
+    Endpoint& a() {
+        return a_;
+    }
+
+    Endpoint& b() {
+        return b_;
+    }
+
+private:
+    Channel a_to_b_;
+    Channel b_to_a_;
+    Endpoint a_;
+    Endpoint b_;
+};
+
+/**
+ * @brief Serial port of a networked serial server, raw TCP or telnet with RFC 2217 port control
+ */
+class TcpTransport final : public Transport {
+public:
+    enum class Mode {
+        //! bytes pass unchanged, i.e. ser2net raw ports
+        raw,
+        //! telnet framing, the line settings are sent with RFC 2217 COM-PORT-OPTION
+        rfc2217
+    };
+
+    /**
+   * @brief Constructor of TCP transport, connects at once
+   * @param host server name or address
+   * @param port TCP port
+   * @param mode framing of the byte stream
+   * @param config line settings to request from an RFC 2217 server
+   */
+    TcpTransport(const std::string& host, unsigned short port, Mode mode = Mode::raw,
+                 const SerialConfig& config = SerialConfig()) : mode_(mode) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *result = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0)
+            return;
+        for (addrinfo *ai = result; ai != nullptr && fd_ < 0; ai = ai->ai_next) {
+            fd_ = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd_ >= 0 && connect(fd_, ai->ai_addr, ai->ai_addrlen) != 0) {
+                close(fd_);
+                fd_ = -1;
+            }
+        }
+        freeaddrinfo(result);
+        if (fd_ < 0)
+            return;
+        /* small writes are serial messages, send them at once */
+        int one = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+        if (mode_ == Mode::rfc2217) {
+            const uint8_t negotiation[] = {iac, will, binary, iac, do_, binary, iac, will, sga,
+                                           iac, do_, sga, iac, will, com_port};
+            /* the settings are only sent once the server agreed to COM-PORT-OPTION */
+            if (!send_all(negotiation, sizeof(negotiation)) || !wait_com_port() || !set_config(config)) {
+                close(fd_);
+                fd_ = -1;
+            }
+        }
+    }
+
+    ~TcpTransport() override {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    TcpTransport(const TcpTransport&) = delete;
+    TcpTransport& operator=(const TcpTransport&) = delete;
+
+    //! the connection is established
+    bool ok() const {
+        return fd_ >= 0;
+    }
+
+    /**
+   * @brief Send the line settings to an RFC 2217 server
+   * @return True if sent, raw connections have nothing to send
+   */
+    bool set_config(const SerialConfig& config) {
+        if (mode_ != Mode::rfc2217)
+            return true;
+        if (com_port_ != Agreement::agreed) {
+            errno = ENOTSUP;
+            return false;
+        }
+        uint8_t baud[4] = {(uint8_t)(config.baudrate >> 24), (uint8_t)(config.baudrate >> 16),
+                           (uint8_t)(config.baudrate >> 8), (uint8_t)config.baudrate};
+        static constexpr uint8_t parities[] = {1, 2, 3, 4, 5};
+        uint8_t parity = parities[0];
+        switch (config.parity) {
+            case Parity::odd: parity = parities[1]; break;
+            case Parity::even: parity = parities[2]; break;
+            case Parity::mark: parity = parities[3]; break;
+            case Parity::space: parity = parities[4]; break;
+            default: break;
+        }
+        uint8_t data_size = (uint8_t)config.data_bits;
+        uint8_t stop_size = (uint8_t)config.stop_bits;
+        uint8_t control = config.flow_control == FlowControl::hardware ? 3 :
+                          config.flow_control == FlowControl::software ? 2 : 1;
+        return send_option(set_baudrate, baud, sizeof(baud)) && send_option(set_datasize, &data_size, 1) &&
+               send_option(set_parity, &parity, 1) && send_option(set_stopsize, &stop_size, 1) &&
+               send_option(set_control, &control, 1);
+    }
+
+    /**
+   * @brief Read the available data bytes, telnet commands are consumed
+   */
+    long long read(uint8_t *buf, size_t len) override {
+        if (nullptr == buf)
+            return -1;
+        if (early_pos_ < early_.size()) {
+            size_t n = std::min(len, early_.size() - early_pos_);
+            memcpy(buf, early_.data() + early_pos_, n);
+            early_pos_ += n;
+            if (early_pos_ == early_.size()) {
+                early_.clear();
+                early_pos_ = 0;
+            }
+            return n;
+        }
+        while (true) {
+            ssize_t r = recv(fd_, buf, len, 0);
+            if (r <= 0) {
+                if (r == 0)
+                    errno = ECONNRESET;
+                return -1;
+            }
+            if (mode_ == Mode::raw)
+                return r;
+            size_t n = filter(buf, r);
+            if (n > 0)
+                return n;
+        }
+    }
+
+    /**
+   * @brief Send the bytes the socket buffer takes, without waiting
+   * @return -1 if failed or with EAGAIN if the socket buffer is full, else the send length
+   */
+    long long write(const uint8_t *buf, size_t len) override {
+        if (nullptr == buf || !send_escape())
+            return -1;
+        if (mode_ == Mode::raw)
+            return send_some(buf, len);
+        /* data bytes equal to IAC are doubled */
+        uint8_t escaped[2048];
+        size_t done = 0;
+        while (done < len) {
+            size_t n = 0;
+            size_t taken = 0;
+            for (; done + taken < len && n + 2 <= sizeof(escaped); ++taken) {
+                escaped[n++] = buf[done + taken];
+                if (buf[done + taken] == iac)
+                    escaped[n++] = iac;
+            }
+            long long r = send_some(escaped, n);
+            if (r < 0)
+                return done > 0 ? (long long)done : -1;
+            if ((size_t)r == n) {
+                done += taken;
+                continue;
+            }
+            /* map the sent bytes back to data bytes, a doubled IAC cut in half is completed later */
+            for (size_t sent = 0; sent < (size_t)r; ++done) {
+                sent += buf[done] == iac ? 2 : 1;
+                escape_pending_ = sent > (size_t)r;
+            }
+            return done;
+        }
+        return len;
+    }
+
+    long long wait_readable(long long nanosecond) override {
+        if (early_pos_ < early_.size())
+            return early_.size() - early_pos_;
+        pollfd pfd{fd_, POLLIN, 0};
+        timespec timeout_ts{(time_t)(nanosecond / 1000000000), (long)(nanosecond % 1000000000)};
+        if (ppoll(&pfd, 1, &timeout_ts, nullptr) <= 0)
+            return -1;
+        int available = 0;
+        ioctl(fd_, FIONREAD, &available);
+        return available;
+    }
+
+    int native_handle() const override {
+        return fd_;
+    }
+
+private:
+    /* telnet (RFC 854) and COM-PORT-OPTION (RFC 2217) codes */
+    static constexpr uint8_t iac = 255, dont = 254, do_ = 253, wont = 252, will = 251, sb = 250, se = 240;
+    static constexpr uint8_t binary = 0, sga = 3, com_port = 44;
+    static constexpr uint8_t set_baudrate = 1, set_datasize = 2, set_parity = 3, set_stopsize = 4, set_control = 5;
+
+    enum class State {
+        data,
+        command,
+        option,
+        subnegotiation,
+        subnegotiation_command
+    };
+
+    //! answer of the server to WILL COM-PORT-OPTION
+    enum class Agreement {
+        pending,
+        agreed,
+        refused
+    };
+
+    //! longest wait for the server to answer WILL COM-PORT-OPTION
+    static constexpr int negotiation_timeout_ms = 1000;
+
+    //! longest wait for room in the socket buffer when sending a telnet command
+    static constexpr int command_timeout_ms = 1000;
+
+    //! send what the socket buffer takes, -1 with EAGAIN if nothing
+    long long send_some(const uint8_t *data, size_t len) {
+        while (true) {
+            ssize_t r = send(fd_, data, len, MSG_NOSIGNAL);
+            if (r >= 0 || errno != EINTR)
+                return r;
+        }
+    }
+
+    //! send the second half of a doubled IAC cut by a short write, false with EAGAIN if it did not fit
+    bool send_escape() {
+        if (!escape_pending_)
+            return true;
+        if (send_some(&iac, 1) != 1)
+            return false;
+        escape_pending_ = false;
+        return true;
+    }
+
+    //! send a telnet command as a whole, waiting at most command_timeout_ms for the socket buffer
+    bool send_all(const uint8_t *data, size_t len) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(command_timeout_ms);
+        while (escape_pending_ || len > 0) {
+            long long r = escape_pending_ ? (send_escape() ? 0 : -1) : send_some(data, len);
+            if (r > 0) {
+                data += r;
+                len -= r;
+                continue;
+            }
+            if (r == 0)
+                continue;
+            if (errno != EAGAIN)
+                return false;
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0) {
+                errno = ETIMEDOUT;
+                return false;
+            }
+            pollfd pfd{fd_, POLLOUT, 0};
+            if (::poll(&pfd, 1, (int)left) < 0 && errno != EINTR)
+                return false;
+        }
+        return true;
+    }
+
+    //! send IAC SB COM-PORT-OPTION command value IAC SE
+    bool send_option(uint8_t command, const uint8_t *value, size_t len) {
+        uint8_t message[16];
+        size_t n = 0;
+        message[n++] = iac;
+        message[n++] = sb;
+        message[n++] = com_port;
+        message[n++] = command;
+        for (size_t i = 0; i < len; ++i) {
+            message[n++] = value[i];
+            if (value[i] == iac)
+                message[n++] = iac;
+        }
+        message[n++] = iac;
+        message[n++] = se;
+        return send_all(message, n);
+    }
+
+    /**
+   * @brief Remove telnet commands in place and answer option requests
+   * @return Number of data bytes left in buf
+   */
+    size_t filter(uint8_t *buf, size_t len) {
+        size_t w = 0;
+        for (size_t r = 0; r < len; ++r) {
+            uint8_t byte = buf[r];
+            switch (state_) {
+                case State::data:
+                    if (byte == iac)
+                        state_ = State::command;
+                    else
+                        buf[w++] = byte;
+                    break;
+                case State::command:
+                    if (byte == iac) {
+                        buf[w++] = iac;
+                        state_ = State::data;
+                    } else if (byte >= will && byte <= dont) {
+                        command_ = byte;
+                        state_ = State::option;
+                    } else {
+                        state_ = byte == sb ? State::subnegotiation : State::data;
+                    }
+                    break;
+                case State::option:
+                    answer(command_, byte);
+                    state_ = State::data;
+                    break;
+                case State::subnegotiation:
+                    /* port state notifications of the server are not used */
+                    if (byte == iac)
+                        state_ = State::subnegotiation_command;
+                    break;
+                case State::subnegotiation_command:
+                    state_ = byte == se ? State::data : State::subnegotiation;
+                    break;
+            }
+        }
+        return w;
+    }
+
+    /**
+   * @brief Read until the server answered WILL COM-PORT-OPTION, data bytes received meanwhile are kept
+   * @return True if the server sent DO, false on DONT, a timeout or a closed connection
+   */
+    bool wait_com_port() {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(negotiation_timeout_ms);
+        uint8_t buf[512];
+        while (com_port_ == Agreement::pending) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0) {
+                errno = ETIMEDOUT;
+                return false;
+            }
+            pollfd pfd{fd_, POLLIN, 0};
+            if (::poll(&pfd, 1, (int)left) < 0 && errno != EINTR)
+                return false;
+            ssize_t r = recv(fd_, buf, sizeof(buf), 0);
+            if (r == 0) {
+                errno = ECONNRESET;
+                return false;
+            }
+            if (r < 0) {
+                if (errno != EAGAIN && errno != EINTR)
+                    return false;
+                continue;
+            }
+            size_t n = filter(buf, r);
+            early_.insert(early_.end(), buf, buf + n);
+        }
+        if (com_port_ == Agreement::refused) {
+            errno = ENOTSUP;
+            return false;
+        }
+        return true;
+    }
+
+    //! refuse options other than the ones requested on connect
+    void answer(uint8_t command, uint8_t option) {
+        if (option == com_port && (command == do_ || command == dont))
+            com_port_ = command == do_ ? Agreement::agreed : Agreement::refused;
+        bool wanted = option == binary || option == sga || option == com_port;
+        if (command == do_ && !wanted) {
+            const uint8_t reply[] = {iac, wont, option};
+            send_all(reply, sizeof(reply));
+        } else if (command == will && !wanted) {
+            const uint8_t reply[] = {iac, dont, option};
+            send_all(reply, sizeof(reply));
+        }
+    }
+
+    int fd_{-1};
+    Mode mode_;
+    //! telnet parser state, kept across reads
+    State state_{State::data};
+    uint8_t command_{0};
+    //! a short write sent only the first IAC of a doubled data byte
+    bool escape_pending_{false};
+    Agreement com_port_{Agreement::pending};
+    //! data bytes received while waiting for the negotiation, served by read() first
+    std::vector<uint8_t> early_;
+    size_t early_pos_{0};
+};
+
+/**
+ * @brief Layout of capture logs, a file header followed by records of a header and the payload
+ */
+namespace capture {
+
+//! file magic and format version
+constexpr char magic[8] = {'S', 'L', 'C', 'A', 'P', 0, 0, 1};
+
+//! direction of a record
+constexpr uint8_t rx = 0;
+constexpr uint8_t tx = 1;
+
+struct FileHeader {
+    char magic[8];
+    //! CLOCK_MONOTONIC nanoseconds when the capture started
+    uint64_t origin;
+};
+
+struct RecordHeader {
+    //! CLOCK_MONOTONIC nanoseconds when the bytes passed read() or write()
+    uint64_t timestamp;
+    uint32_t length;
+    uint8_t direction;
+    uint8_t reserved[3];
+};
+
+static_assert(sizeof(FileHeader) == 16 && sizeof(RecordHeader) == 16, "capture layout must not change");
+
+inline uint64_t now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+}
+
+/**
+ * @brief Capture sink appending timestamped records to a binary log through a background thread
+ *
+ * Records are copied into large page aligned buffers, full buffers are written out by the thread.
+ * When the disk falls behind and no buffer is free, records are dropped instead of stalling the I/O path.
+ */
+class CaptureWriter {
+public:
+    /**
+   * @brief Constructor of capture writer, the file is truncated and the buffers are allocated here
+   * @param path log file
+   * @param buffer_size size of each buffer, a multiple of the page size
+   * @param buffers number of buffers
+   */
+    explicit CaptureWriter(const std::string& path, size_t buffer_size = 1 << 20, size_t buffers = 4)
+        : fd_(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)),
+          buffer_size_(std::max<size_t>(4096, (buffer_size + 4095) & ~(size_t)4095)) {
+        if (fd_ < 0)
+            return;
+        capture::FileHeader header{};
+        memcpy(header.magic, capture::magic, sizeof(header.magic));
+        header.origin = capture::now();
+        if (::write(fd_, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+            close(fd_);
+            fd_ = -1;
+            return;
+        }
+        for (size_t i = 0; i < std::max<size_t>(buffers, 2); ++i) {
+            buffers_.emplace_back(static_cast<uint8_t *>(aligned_alloc(4096, buffer_size_)));
+            if (buffers_.back() == nullptr) {
+                /* reported through ok() like a failed open, record() then does nothing */
+                buffers_.clear();
+                free_.clear();
+                close(fd_);
+                fd_ = -1;
+                return;
+            }
+            free_.push_back(buffers_.back().get());
+        }
+        current_ = free_.back();
+        free_.pop_back();
+        thread_ = std::thread(&CaptureWriter::run, this);
+    }
+
+    ~CaptureWriter() {
+        if (fd_ < 0)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            submit();
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+        close(fd_);
+    }
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    //! the log file is open
+    bool ok() const {
+        return fd_ >= 0 && !failed_.load(std::memory_order_relaxed);
+    }
+
+    /**
+   * @brief Append a record, safe to call from several threads
+   * @param direction capture::rx or capture::tx
+   * @param data Bytes which passed the device
+   * @param len Number of bytes
+   * @note A chunk is dropped as a whole when it does not fit, the log never holds part of it
+   */
+    void record(uint8_t direction, const uint8_t *data, size_t len) {
+        if (fd_ < 0 || len == 0)
+            return;
+        capture::RecordHeader header{capture::now(), 0, direction, {}};
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!fits(len)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        while (len > 0) {
+            /* chunks larger than a buffer are split into records with the same timestamp */
+            size_t piece = std::min(len, buffer_size_ - sizeof(header));
+            if (current_ == nullptr || fill_ + sizeof(header) + piece > buffer_size_)
+                rotate();
+            header.length = (uint32_t)piece;
+            memcpy(current_ + fill_, &header, sizeof(header));
+            memcpy(current_ + fill_ + sizeof(header), data, piece);
+            fill_ += sizeof(header) + piece;
+            data += piece;
+            len -= piece;
+        }
+    }
+
+    /**
+   * @brief Hand the partially filled buffer to the thread and wait until everything is on disk
+   */
+    void flush() {
+        if (fd_ < 0)
+            return;
+        std::unique_lock<std::mutex> lock(mutex_);
+        submit();
+        cv_.notify_all();
+        cv_.wait(lock, [this] { return full_.empty() && !writing_; });
+        if (current_ == nullptr)
+            rotate();
+    }
+
+    //! number of recorded chunks dropped because no buffer was free
+    size_t dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Free {
+        void operator()(uint8_t *p) const {
+            free(p);
+        }
+    };
+
+    struct Full {
+        uint8_t *data;
+        size_t size;
+    };
+
+    //! queue the current buffer if it holds data, with mutex_ held
+    void submit() {
+        if (current_ != nullptr && fill_ > 0) {
+            full_.push_back(Full{current_, fill_});
+            current_ = nullptr;
+            fill_ = 0;
+            cv_.notify_all();
+        }
+    }
+
+    //! check that all records of a chunk fit into the current and the free buffers, with mutex_ held
+    bool fits(size_t len) const {
+        size_t room = current_ != nullptr ? buffer_size_ - fill_ : 0;
+        size_t spare = free_.size();
+        while (len > 0) {
+            size_t piece = std::min(len, buffer_size_ - sizeof(capture::RecordHeader));
+            if (sizeof(capture::RecordHeader) + piece > room) {
+                if (spare == 0)
+                    return false;
+                --spare;
+                room = buffer_size_;
+            }
+            room -= sizeof(capture::RecordHeader) + piece;
+            len -= piece;
+        }
+        return true;
+    }
+
+    //! replace the current buffer by a free one, with mutex_ held
+    bool rotate() {
+        submit();
+        if (current_ == nullptr) {
+            if (free_.empty())
+                return false;
+            current_ = free_.back();
+            free_.pop_back();
+        }
+        return true;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this] { return stop_ || !full_.empty(); });
+            if (full_.empty())
+                return;
+            Full buffer = full_.front();
+            full_.erase(full_.begin());
+            writing_ = true;
+            lock.unlock();
+            for (size_t done = 0; done < buffer.size;) {
+                ssize_t r = ::write(fd_, buffer.data + done, buffer.size - done);
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r <= 0) {
+                    failed_.store(true, std::memory_order_relaxed);
+                    break;
+                }
+                done += r;
+            }
+            lock.lock();
+            writing_ = false;
+            free_.push_back(buffer.data);
+            cv_.notify_all();
+        }
+    }
+
+    int fd_;
+    size_t buffer_size_;
+    std::vector<std::unique_ptr<uint8_t[], Free>> buffers_;
+    //! buffer being filled, nullptr if none was free
+    uint8_t *current_{nullptr};
+    size_t fill_{0};
+    std::vector<uint8_t *> free_;
+    //! buffers waiting for the thread, in file order
+    std::vector<Full> full_;
+    bool writing_{false};
+    bool stop_{false};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<size_t> dropped_{0};
+    std::atomic<bool> failed_{false};
+    std::thread thread_;
+};
+
+/**
+ * @brief serial class
+ */
+class Serial final : public Transport {
+public:
+    /**
+   * @brief Constructor of serial device
+   * @param port_name port name, i.e. /dev/ttyUSB0
+   * @param baudrate serial baudrate
+   */
+    Serial(const std::string& port_name, const int baudrate) : Serial(port_name, SerialConfig().baud(baudrate)) {}
+
+    /**
+   * @brief Constructor of serial device
+   * @param port_name port name, i.e. /dev/ttyUSB0
+   * @param config line settings, i.e. preset::modbus_rtu
+   */
+    Serial(const std::string& port_name, const SerialConfig& config) : port_name_(port_name),
+                                                                      config_(config),
+                                                                      new_termios_(config.to_termios()) {}
+
+    Serial(const Serial&) = delete;
+    Serial& operator=(const Serial&) = delete;
+
+    /**
+   * @brief Move constructor, the file descriptor and the async thread are taken over
+   * @note Pollers, event loops and frame readers refer to the device by address, register the new object again
+   */
+    Serial(Serial&& other) noexcept : port_name_(std::move(other.port_name_)),
+                                      config_(other.config_),
+                                      serial_fd_(std::exchange(other.serial_fd_, -1)),
+                                      new_termios_(other.new_termios_),
+                                      old_termios_(other.old_termios_),
+                                      unread_(std::move(other.unread_)),
+                                      unread_pos_(std::exchange(other.unread_pos_, 0)),
+                                      batch_(std::move(other.batch_)),
+                                      async_(std::move(other.async_)),
+                                      async_rx_capacity_(std::exchange(other.async_rx_capacity_, 0)),
+                                      async_tx_capacity_(std::exchange(other.async_tx_capacity_, 0)),
+                                      latency_(std::move(other.latency_)),
+                                      stats_(std::move(other.stats_)),
+                                      capture_(std::exchange(other.capture_, nullptr)) {}
+
+    /**
+   * @brief Move assignment, the current device is closed first
+   */
+    Serial& operator=(Serial&& other) noexcept {
+        if (this != &other) {
+            release();
+            port_name_ = std::move(other.port_name_);
+            config_ = other.config_;
+            serial_fd_ = std::exchange(other.serial_fd_, -1);
+            new_termios_ = other.new_termios_;
+            old_termios_ = other.old_termios_;
+            unread_ = std::move(other.unread_);
+            unread_pos_ = std::exchange(other.unread_pos_, 0);
+            batch_ = std::move(other.batch_);
+            async_ = std::move(other.async_);
+            async_rx_capacity_ = std::exchange(other.async_rx_capacity_, 0);
+            async_tx_capacity_ = std::exchange(other.async_tx_capacity_, 0);
+            latency_ = std::move(other.latency_);
+            stats_ = std::move(other.stats_);
+            capture_ = std::exchange(other.capture_, nullptr);
+        }
+        return *this;
+    }
+
+    /**
+   * @brief Destructor of serial device to close the device
+   */
+    ~Serial() {
+        release();
+    }
+
+    /**
+   * @brief Initialization of serial device to config and open the device
+   * @return True if success, false with EINVAL if the config is not valid()
+   */
+    bool init() {
+        if (port_name_.c_str() == nullptr)
+            return false;
+        /* runtime built configs are not checked at compile time */
+        if (!config_.valid()) {
+            errno = EINVAL;
+            return false;
+        }
+        /* initializing again reopens the device instead of leaking the descriptor */
+        if (serial_fd_ >= 0)
+            disconnect();
+        if (open_device() && config_device()) {
+            return true;
+        } else {
+            close_device();
+            return false;
+        }
+    }
+
+    /**
+   * @brief Wait until the device has data to be read
+   * @param nanosecond Timeout in nanosecond
+   * @return -1 if timeout or failed, else the available bytes
+   */
+    long long wait_readable(long long nanosecond) override {
+        // Bytes left over by read_until() are readable at once
+        if (unread_pos_ < unread_.size())
+            return unread_.size() - unread_pos_;
+
+        // Setup a poll call to block for serial data or a timeout
+        pollfd serial_pollfd{serial_fd_, POLLIN, 0};
+        int r;
+        auto start = stats_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+        while (true) {
+            // Wake up in time to flush batched writes
+            long long timeout = nanosecond;
+            long long batch_left = batch_ ? batch_->time_left() : -1;
+            if (batch_left == 0) {
+                flush();
+            } else if (batch_left > 0 && batch_left < timeout) {
+                timeout = batch_left;
+            }
+
+            timespec timeout_ts;
+            timeout_ts.tv_sec = timeout / (long long)1e9;
+            timeout_ts.tv_nsec = timeout % (long long)1e9;
+
+            r = ppoll(&serial_pollfd, 1, &timeout_ts, NULL);
+            if (r != 0 || timeout == nanosecond)
+                break;
+            nanosecond -= timeout;
+        }
+
+        if (r <= 0)
+            return -1;
+        if (stats_)
+            stats_->wait_latency.record(elapsed_ns(start));
+        
+        // Get avaliable bytes
+        ioctl(serial_fd_, FIONREAD, &r);
+
+        return r;
+    }
+
+    /**
+   * @brief Change how read() waits for data, applied at once if the device is open
+   * @param policy read policy, i.e. ReadPolicy::min_bytes(64)
+   * @return False if the policy is invalid or the driver rejected it
+   * @note SerialPoller and the async mode need a non-blocking policy
+   */
+    bool set_read_policy(const ReadPolicy& policy) {
+        if (!config_.policy(policy).valid()) {
+            errno = EINVAL;
+            return false;
+        }
+        config_.read_policy = policy;
+        new_termios_.c_cc[VMIN] = policy.vmin;
+        new_termios_.c_cc[VTIME] = policy.vtime;
+        if (serial_fd_ < 0)
+            return true;
+        return apply_termios() && set_blocking(policy.blocking && !async_);
+    }
+
+    const ReadPolicy& read_policy() const {
+        return config_.read_policy;
+    }
+
+    /**
+   * @brief Change the line settings, applied at once if the device is open
+   * @param config line settings, i.e. preset::dmx512
+   * @return False if the settings are invalid or the driver rejected them
+   */
+    bool set_config(const SerialConfig& config) {
+        if (!config.valid()) {
+            errno = EINVAL;
+            return false;
+        }
+        config_ = config;
+        new_termios_ = config.to_termios();
+        if (serial_fd_ < 0)
+            return true;
+        return apply_termios() && set_blocking(config.read_policy.blocking && !async_) &&
+               verify_baudrate(config.baudrate);
+    }
+
+    const SerialConfig& config() const {
+        return config_;
+    }
+
+    /**
+   * @brief Switch flow control, applied at once if the device is open
+   * @param flow_control RTS/CTS for binary bulk transfers, XON/XOFF only for text as it reserves 0x11 and 0x13
+   * @return True if success
+   */
+    bool set_flow_control(FlowControl flow_control) {
+        return set_config(config_.flow(flow_control));
+    }
+
+    /**
+   * @brief Get the modem lines
+   * @return -1 if failed, else a mask of modem::dtr, modem::cts, ...
+   */
+    int modem_lines() const {
+        int lines = 0;
+        return ioctl(serial_fd_, TIOCMGET, &lines) == 0 ? lines : -1;
+    }
+
+    /**
+   * @brief Raise and lower output lines in one call, other lines are left alone
+   * @param set Lines to raise, i.e. modem::dtr
+   * @param clear Lines to lower, i.e. modem::rts
+   * @return True if success
+   * @note RTS is driven by the driver while hardware flow control is on
+   */
+    bool set_modem_lines(int set, int clear) {
+        return (set == 0 || ioctl(serial_fd_, TIOCMBIS, &set) == 0) &&
+               (clear == 0 || ioctl(serial_fd_, TIOCMBIC, &clear) == 0);
+    }
+
+    /**
+   * @brief Replace all output lines
+   * @param lines Mask of lines to be raised, the others are lowered
+   * @return True if success
+   */
+    bool set_modem_lines(int lines) {
+        return ioctl(serial_fd_, TIOCMSET, &lines) == 0;
+    }
+
+    bool set_dtr(bool level) {
+        return level ? set_modem_lines(modem::dtr, 0) : set_modem_lines(0, modem::dtr);
+    }
+
+    bool set_rts(bool level) {
+        return level ? set_modem_lines(modem::rts, 0) : set_modem_lines(0, modem::rts);
+    }
+
+    /**
+   * @brief Block until one of the input lines changes, i.e. a CTS edge or a ring
+   * @param lines Lines to watch, i.e. modem::cts | modem::dsr
+   * @return -1 if failed or unsupported by the driver, else the lines after the change
+   */
+    int wait_modem_change(int lines) const {
+        while (ioctl(serial_fd_, TIOCMIWAIT, lines) != 0) {
+            if (errno != EINTR)
+                return -1;
+        }
+        return modem_lines();
+    }
+
+    /**
+   * @brief Wait until all written bytes, batched ones included, left the transmitter, i.e. before switching baudrate
+   * @return True if success
+   */
+    bool drain() {
+        if (!flush_pending())
+            return false;
+        while (tcdrain(serial_fd_) != 0) {
+            if (errno != EINTR)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+   * @brief Drop all received bytes not read yet, in the driver and left over by read_until()
+   * @return True if success, false with EBUSY in async mode, whose ring the I/O thread fills meanwhile
+   */
+    bool discard_input() {
+        if (is_async()) {
+            errno = EBUSY;
+            return false;
+        }
+        unread_.clear();
+        unread_pos_ = 0;
+        return tcflush(serial_fd_, TCIFLUSH) == 0;
+    }
+
+    //! called whenever a bulk transfer progressed
+    using TransferCallback = std::function<void(const TransferProgress&)>;
+
+    /**
+   * @brief Stream a file to the device, i.e. a firmware image
+   * @param fd File to be sent
+   * @param offset Offset of the first byte in the file
+   * @param len Number of bytes to be sent
+   * @param progress Called each time the driver accepted more bytes, and once when done
+   * @param wait_drained Wait until the last byte left the transmitter before completing
+   * @return -1 if failed, else the number of bytes sent
+   * @note Uses sendfile() into the tty where the kernel supports it, else writes from a
+   * mapping of the file. Capture needs the bytes in userspace, so it always writes.
+   */
+    long long send_file(int fd, off_t offset, size_t len, const TransferCallback& progress = {},
+                        bool wait_drained = true) {
+        if (!begin_transfer())
+            return -1;
+        TransferProgress state{0, len, false};
+        if (!capture_) {
+            while (state.queued < len) {
+                auto start = stats_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+                size_t chunk = std::min(len - state.queued, transfer_chunk);
+                ssize_t r = sendfile(serial_fd_, fd, &offset, chunk);
+                if (stats_)
+                    stats_->record_write(chunk, r, elapsed_ns(start));
+                if (r > 0) {
+                    state.queued += r;
+                    if (progress)
+                        progress(state);
+                } else if (r == 0) {
+                    errno = ENODATA;  /* the file is shorter than len */
+                    return -1;
+                } else if (errno == EAGAIN) {
+                    if (!wait_writable())
+                        return -1;
+                } else if (errno == EINTR) {
+                } else if (state.queued == 0 && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+                    break;  /* no splice support in this tty driver */
+                } else {
+                    return -1;
+                }
+            }
+            if (state.queued == len)
+                return end_transfer(state, progress, wait_drained);
+        }
+        /* pages past the end of the file would fault with SIGBUS */
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+            return -1;
+        if (offset < 0 || (off_t)len > st.st_size - std::min(offset, st.st_size)) {
+            errno = ENODATA;
+            return -1;
+        }
+        /* map whole pages around the requested range */
+        off_t page = sysconf(_SC_PAGESIZE);
+        off_t map_offset = offset / page * page;
+        size_t map_len = len + (offset - map_offset);
+        void *image = len > 0 ? mmap(nullptr, map_len, PROT_READ, MAP_PRIVATE, fd, map_offset) : MAP_FAILED;
+        if (image == MAP_FAILED) {
+            if (len > 0)
+                return -1;
+            return end_transfer(state, progress, wait_drained);
+        }
+        madvise(image, map_len, MADV_SEQUENTIAL);
+        long long r = send_image(static_cast<const uint8_t *>(image) + (offset - map_offset), len, progress,
+                                 wait_drained);
+        int error = errno;
+        munmap(image, map_len);
+        errno = error;
+        return r;
+    }
+
+    /**
+   * @brief Stream a buffer to the device with large writes, waiting for output readiness in between
+   * @param image Data to be sent, i.e. a mapped firmware image
+   * @param len Data length
+   * @param progress Called each time the driver accepted more bytes, and once when done
+   * @param wait_drained Wait until the last byte left the transmitter before completing
+   * @return -1 if failed, else the number of bytes sent
+   */
+    long long send_image(const uint8_t *image, size_t len, const TransferCallback& progress = {},
+                         bool wait_drained = true) {
+        if ((nullptr == image && len > 0) || !begin_transfer())
+            return -1;
+        TransferProgress state{0, len, false};
+        while (state.queued < len) {
+            ssize_t r = sys_write(image + state.queued, std::min(len - state.queued, transfer_chunk));
+            if (r > 0) {
+                state.queued += r;
+                if (progress)
+                    progress(state);
+            } else if (r < 0 && errno == EAGAIN) {
+                if (!wait_writable())
+                    return -1;
+            } else if (r < 0 && errno != EINTR) {
+                return -1;
+            }
+        }
+        return end_transfer(state, progress, wait_drained);
+    }
+
+    /**
+   * @brief Apply kernel side latency settings and read back what took effect
+   * @param settings Requested settings
+   * @return Effective settings, complete is false if the driver rejected or adjusted any of them
+   * @note Writing the latency timer usually needs write access to sysfs
+   */
+    LatencyReport tune_latency(const LatencySettings& settings) {
+        latency_ = settings;
+        bool applied = serial_fd_ >= 0 && set_low_latency(settings.low_latency);
+        if (settings.latency_timer >= 0) {
+            std::ofstream ofs(latency_timer_path());
+            ofs << settings.latency_timer << std::endl;
+            applied = applied && ofs.good();
+        }
+        if (settings.rs485) {
+            struct serial_rs485 rs485{};
+            rs485.flags = (settings.rs485->enabled ? SER_RS485_ENABLED : 0) |
+                          (settings.rs485->rts_on_send ? SER_RS485_RTS_ON_SEND : SER_RS485_RTS_AFTER_SEND) |
+                          (settings.rs485->rx_during_tx ? SER_RS485_RX_DURING_TX : 0);
+            rs485.delay_rts_before_send = settings.rs485->delay_before_send;
+            rs485.delay_rts_after_send = settings.rs485->delay_after_send;
+            applied = applied && ioctl(serial_fd_, TIOCSRS485, &rs485) == 0;
+        }
+        LatencyReport report = latency_report();
+        report.complete = applied && report.low_latency == settings.low_latency &&
+                          (settings.latency_timer < 0 || report.latency_timer == settings.latency_timer) &&
+                          (!settings.rs485 || (report.rs485 &&
+                                               report.rs485->enabled == settings.rs485->enabled &&
+                                               report.rs485->rts_on_send == settings.rs485->rts_on_send &&
+                                               report.rs485->rx_during_tx == settings.rs485->rx_during_tx &&
+                                               report.rs485->delay_before_send == settings.rs485->delay_before_send &&
+                                               report.rs485->delay_after_send == settings.rs485->delay_after_send));
+        return report;
+    }
+
+    /**
+   * @brief Read the current kernel side latency settings
+   * @return Current settings, complete is always false
+   */
+    LatencyReport latency_report() const {
+        LatencyReport report;
+        struct serial_struct kernel_serial_settings{};
+        if (serial_fd_ >= 0 && ioctl(serial_fd_, TIOCGSERIAL, &kernel_serial_settings) == 0) {
+            report.low_latency_supported = true;
+            report.low_latency = kernel_serial_settings.flags & ASYNC_LOW_LATENCY;
+        }
+        std::ifstream ifs(latency_timer_path());
+        if (!(ifs >> report.latency_timer))
+            report.latency_timer = -1;
+        struct serial_rs485 rs485{};
+        if (serial_fd_ >= 0 && ioctl(serial_fd_, TIOCGRS485, &rs485) == 0) {
+            Rs485Settings current;
+            current.enabled = rs485.flags & SER_RS485_ENABLED;
+            current.rts_on_send = rs485.flags & SER_RS485_RTS_ON_SEND;
+            current.rx_during_tx = rs485.flags & SER_RS485_RX_DURING_TX;
+            current.delay_before_send = rs485.delay_rts_before_send;
+            current.delay_after_send = rs485.delay_rts_after_send;
+            report.rs485 = current;
+        }
+        return report;
+    }
+
+    /**
+   * @brief Get the file descriptor of the device
+   * @return -1 if the device is not open
+   */
+    int native_handle() const override {
+        return serial_fd_;
+    }
+
+    /**
+   * @brief Get the port name
+   * @return Port name, i.e. /dev/ttyUSB0
+   */
+    const std::string& port_name() const {
+        return port_name_;
+    }
+
+    /**
+   * @brief Check whether the device is open
+   * @return True if open
+   */
+    bool is_open() const {
+        return serial_fd_ >= 0;
+    }
+
+    /**
+   * @brief Close a device which went away, the settings are kept for reopen()
+   */
+    void disconnect() {
+        if (async_) {
+            async_.reset();
+            set_blocking(config_.read_policy.blocking);
+        }
+        close_device();
+        unread_.clear();
+        unread_pos_ = 0;
+    }
+
+    /**
+   * @brief Open the device again with the configured settings, i.e. after a usb adapter reenumerated
+   * @param port_name New port name, empty to keep the current one
+   * @return True if the device was reopened and configured
+   * @note The file descriptor changes, it has to be registered again with pollers and event loops
+   */
+    bool reopen(const std::string& port_name = {}) {
+        disconnect();
+        if (!port_name.empty())
+            port_name_ = port_name;
+        if (!init())
+            return false;
+        if (latency_)
+            tune_latency(*latency_);
+        if (async_rx_capacity_ && !start_async(async_rx_capacity_, async_tx_capacity_)) {
+            close_device();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+   * @brief Serial device read function
+   * @param buf Given buffer to be updated by reading
+   * @param len Read data length
+   * @return -1 if failed, else the read length
+   */
+    long long read(uint8_t *buf, size_t len) override {
+        if (nullptr == buf) {
+            return -1;
+        } else {
+            if (unread_pos_ < unread_.size())
+                return take_unread(buf, len);
+            if (config_.read_policy.timeout >= 0 && !wait_policy())
+                return 0;
+            return sys_read(buf, len);
+        }
+    }
+
+    /**
+   * @brief Read exactly n bytes unless the deadline passes first
+   * @param buf Given buffer to be updated by reading
+   * @param n Number of bytes to be read
+   * @param deadline steady clock time by which the read gives up
+   * @return Bytes read so far, complete if all n bytes were read
+   * @note With ReadPolicy::min_bytes(n) the kernel reports readiness only once n bytes arrived
+   */
+    ReadProgress read_exact(uint8_t *buf, size_t n, std::chrono::steady_clock::time_point deadline) {
+        ReadProgress progress{};
+        if (nullptr == buf) {
+            progress.error = EINVAL;
+            return progress;
+        }
+        progress.count = take_unread(buf, n);
+        while (progress.count < n && read_some(buf, n, deadline, progress)) {
+        }
+        progress.complete = progress.count == n;
+        return progress;
+    }
+
+    /**
+   * @brief Read up to and including a delimiter unless the deadline passes first
+   * @param buf Given buffer to be updated by reading
+   * @param len Buffer length
+   * @param delimiter Byte terminating the read, i.e. '\n'
+   * @param deadline steady clock time by which the read gives up
+   * @return Bytes read so far, complete if they end with the delimiter, ENOBUFS if the buffer filled up
+   * @note Bytes received after the delimiter are kept for the next read
+   */
+    ReadProgress read_until(uint8_t *buf, size_t len, uint8_t delimiter,
+                            std::chrono::steady_clock::time_point deadline) {
+        ReadProgress progress{};
+        if (nullptr == buf) {
+            progress.error = EINVAL;
+            return progress;
+        }
+        size_t scanned = 0;
+        if (unread_pos_ < unread_.size()) {
+            size_t pending = unread_.size() - unread_pos_;
+            size_t end = simd::find_byte(unread_.data() + unread_pos_, pending, delimiter);
+            if (end < pending && end < len) {
+                /* a whole line is left over, the device is not read */
+                progress.count = take_unread(buf, end + 1);
+                progress.complete = true;
+                return progress;
+            }
+            /* either all leftovers fit, or the buffer is full and ENOBUFS follows before any read */
+            progress.count = take_unread(buf, len);
+            scanned = progress.count;
+        }
+        while (true) {
+            size_t end = scanned + simd::find_byte(buf + scanned, progress.count - scanned, delimiter);
+            if (end < progress.count) {
+                /* keep what came after the delimiter */
+                unread_.assign(buf + end + 1, buf + progress.count);
+                unread_pos_ = 0;
+                progress.count = end + 1;
+                progress.complete = true;
+                break;
+            }
+            scanned = progress.count;
+            if (progress.count == len) {
+                progress.error = ENOBUFS;
+                break;
+            }
+            if (!read_some(buf, len, deadline, progress))
+                break;
+        }
+        return progress;
+    }
+
+    /**
+   * @brief Write the buffer data into device to send the data
+   * @param buf Given buffer to be sent
+   * @param len Send data length
+   * @return < 0 if failed, else the send length
+   */
+    long long write(const uint8_t *buf, size_t len) override {
+        if (batch_)
+            return write_batched(buf, len);
+        return sys_write(buf, len);
+    }
+
+    /**
+   * @brief Scatter read into several buffers with one syscall
+   * @param buffers Given buffers to be updated in order, at most IOV_MAX
+   * @return -1 if failed, else the total read length
+   */
+    long long read(std::span<const iovec> buffers) {
+        if (buffers.size() > IOV_MAX)
+            return -1;
+        if (unread_pos_ < unread_.size()) {
+            long long total = 0;
+            for (const auto& part : buffers)
+                total += take_unread(static_cast<uint8_t *>(part.iov_base), part.iov_len);
+            return total;
+        }
+        if (config_.read_policy.timeout >= 0 && !wait_policy())
+            return 0;
+        ssize_t r = ::readv(serial_fd_, buffers.data(), (int)buffers.size());
+        if (stats_)
+            stats_->record_read(total_length(buffers), r);
+        if (capture_ && r > 0)
+            capture_buffers(capture::rx, buffers, r);
+        return r;
+    }
+
+    /**
+   * @brief Gather write several buffers with one syscall, i.e. header, payload and checksum
+   * @param buffers Given buffers to be sent in order, at most IOV_MAX
+   * @return < 0 if failed before any byte was accepted, else the total send length
+   * @note A short count means the device stopped taking bytes, the rest has to be sent again
+   */
+    long long write(std::span<const iovec> buffers) {
+        if (buffers.size() > IOV_MAX)
+            return -1;
+        if (batch_) {
+            long long total = 0;
+            for (const auto& part : buffers) {
+                long long r = write_batched(static_cast<const uint8_t *>(part.iov_base), part.iov_len);
+                if (r < 0)
+                    return total > 0 ? total : r;
+                total += r;
+                /* a later buffer must not go out after a hole */
+                if ((size_t)r < part.iov_len)
+                    break;
+            }
+            return total;
+        }
+        auto start = stats_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        ssize_t r = ::writev(serial_fd_, buffers.data(), (int)buffers.size());
+        if (stats_)
+            stats_->record_write(total_length(buffers), r, elapsed_ns(start));
+        if (capture_ && r > 0)
+            capture_buffers(capture::tx, buffers, r);
+        return r;
+    }
+
+    /**
+   * @brief Coalesce small writes into one buffer, flushed when full or after a delay
+   * @param threshold batch buffer size in bytes, larger writes bypass the buffer
+   * @param nanosecond maximum delay of the first batched byte
+   * @note Expired batches are flushed by write(), wait_readable() and flush_if_due()
+   * @note A previous batch is written out first, blocking until the device took it
+   */
+    void enable_write_batching(size_t threshold, long long nanosecond) {
+        flush_pending();
+        batch_.reset(new WriteBatch(threshold ? threshold : 1, nanosecond));
+    }
+
+    /**
+   * @brief Flush the pending batch and write directly again
+   * @note Blocks until the device took the whole batch
+   */
+    void disable_write_batching() {
+        flush_pending();
+        batch_.reset();
+    }
+
+    /**
+   * @brief Write out the pending batch
+   * @return < 0 if failed, else the send length, bytes the device did not take stay pending
+   */
+    long long flush() {
+        if (!batch_ || batch_->size == 0)
+            return 0;
+        long long r = sys_write(batch_->data.get(), batch_->size);
+        if (r < 0)
+            return errno == EAGAIN ? 0 : r;
+        batch_->consume(r);
+        return r;
+    }
+
+    /**
+   * @brief Write out the pending batch if its delay has expired
+   * @return < 0 if failed, else the send length
+   */
+    long long flush_if_due() {
+        return batch_ && batch_->time_left() == 0 ? flush() : 0;
+    }
+
+    /**
+   * @brief Get the number of batched bytes not written to the device yet
+   */
+    size_t pending_write() const {
+        return batch_ ? batch_->size : 0;
+    }
+
+    /**
+   * @brief Start counting I/O calls and timing waits and writes, including those of the async thread
+   * @note The statistics stay enabled for the lifetime of the device
+   */
+    void enable_stats() {
+        if (stats_)
+            return;
+        stats_.reset(new IoStats());
+        if (async_)
+            async_->stats.store(stats_.get(), std::memory_order_relaxed);
+    }
+
+    /**
+   * @brief Get a snapshot of the statistics, safe while the async thread runs
+   * @return Statistics, all zero unless enable_stats() was called
+   */
+    SerialStats stats() const {
+        return stats_ ? stats_->snapshot(serial_fd_) : SerialStats();
+    }
+
+    void reset_stats() {
+        if (stats_)
+            stats_->reset();
+    }
+
+    /**
+   * @brief Capture all bytes read from and written to the device, including those of the async thread
+   * @param sink Capture writer outliving the device, nullptr to stop capturing
+   */
+    void set_capture(CaptureWriter *sink) {
+        capture_ = sink;
+        if (async_)
+            async_->capture.store(sink, std::memory_order_relaxed);
+    }
+
+    /**
+   * @brief Awaitable read() on an event loop
+   */
+    struct ReadAwaiter : EventLoop::Operation {
+        ReadAwaiter(Serial& serial, EventLoop& loop, uint8_t *buf, size_t len)
+            : EventLoop::Operation{retry, {}}, serial(serial), loop(loop), buf(buf), len(len) {}
+
+        static bool retry(EventLoop::Operation *op) {
+            return static_cast<ReadAwaiter *>(op)->attempt();
+        }
+
+        bool attempt() {
+            do {
+                result = serial.read(buf, len);
+            } while (result < 0 && errno == EINTR);
+            return result >= 0 || errno != EAGAIN;
+        }
+
+        bool await_ready() {
+            return attempt();
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) {
+            handle = h;
+            return loop.watch(serial.native_handle(), false, this);
+        }
+
+        long long await_resume() const {
+            return result;
+        }
+
+        Serial& serial;
+        EventLoop& loop;
+        uint8_t *buf;
+        size_t len;
+        long long result{-1};
+    };
+
+    /**
+   * @brief Awaitable write() on an event loop, completes once all bytes are written
+   */
+    struct WriteAwaiter : EventLoop::Operation {
+        WriteAwaiter(Serial& serial, EventLoop& loop, const uint8_t *buf, size_t len)
+            : EventLoop::Operation{retry, {}}, serial(serial), loop(loop), buf(buf), len(len) {}
+
+        static bool retry(EventLoop::Operation *op) {
+            return static_cast<WriteAwaiter *>(op)->attempt();
+        }
+
+        bool attempt() {
+            while (done < len) {
+                long long r = serial.write(buf + done, len - done);
+                if (r > 0) {
+                    done += r;
+                } else if (r < 0 && errno == EAGAIN) {
+                    return false;
+                } else if (r == 0 || errno != EINTR) {
+                    failed = true;
+                    return true;
+                }
+            }
+            return true;
+        }
+
+        bool await_ready() {
+            return nullptr == buf ? (failed = true) : attempt();
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) {
+            handle = h;
+            failed = !loop.watch(serial.native_handle(), true, this);
+            return !failed;
+        }
+
+        long long await_resume() const {
+            return failed ? -1 : (long long)done;
+        }
+
+        Serial& serial;
+        EventLoop& loop;
+        const uint8_t *buf;
+        size_t len;
+        size_t done{0};
+        bool failed{false};
+    };
+
+    /**
+   * @brief Read on an event loop, co_await suspends until data is available
+   * @param loop Event loop running on this thread
+   * @param buf Given buffer to be updated by reading
+   * @param len Read data length
+   * @return Awaitable giving -1 if failed, else the read length
+   * @note The read policy must be non-blocking
+   */
+    ReadAwaiter async_read(EventLoop& loop, uint8_t *buf, size_t len) {
+        return ReadAwaiter(*this, loop, buf, len);
+    }
+
+    /**
+   * @brief Write on an event loop, co_await suspends until all bytes are written
+   * @param loop Event loop running on this thread
+   * @param buf Given buffer to be sent
+   * @param len Send data length
+   * @return Awaitable giving -1 if failed, else len
+   */
+    WriteAwaiter async_write(EventLoop& loop, const uint8_t *buf, size_t len) {
+        return WriteAwaiter(*this, loop, buf, len);
+    }
+
+    /**
+   * @brief Start the background I/O thread which moves data between the device and two rings
+   * @param rx_capacity receive ring size in bytes, 0 for the rx_buffer of the config
+   * @param tx_capacity transmit ring size in bytes, 0 for the tx_buffer of the config
+   * @return True if success
+   * @note read() and write() should not be mixed with try_read() and try_write()
+   */
+    bool start_async(size_t rx_capacity = 0, size_t tx_capacity = 0) {
+        if (serial_fd_ < 0 || async_)
+            return false;
+        rx_capacity = rx_capacity ? rx_capacity : config_.rx_buffer;
+        tx_capacity = tx_capacity ? tx_capacity : config_.tx_buffer;
+        std::unique_ptr<AsyncIo> async(new AsyncIo(rx_capacity, tx_capacity));
+        async->stats.store(stats_.get(), std::memory_order_relaxed);
+        async->capture.store(capture_, std::memory_order_relaxed);
+        if (!set_blocking(false) || !async->open(serial_fd_)) {
+            set_blocking(config_.read_policy.blocking);
+            return false;
+        }
+        async_ = std::move(async);
+        async_rx_capacity_ = rx_capacity;
+        async_tx_capacity_ = tx_capacity;
+        return true;
+    }
+
+    /**
+   * @brief Stop the background I/O thread, data left in the rings is discarded
+   */
+    void stop_async() {
+        async_rx_capacity_ = async_tx_capacity_ = 0;
+        if (async_) {
+            async_.reset();
+            set_blocking(config_.read_policy.blocking);
+        }
+    }
+
+    /**
+   * @brief Check whether the background I/O thread is running without error
+   * @return True if running
+   */
+    bool is_async() const {
+        return async_ && !async_->failed.load(std::memory_order_acquire);
+    }
+
+    /**
+   * @brief Non-blocking read from the receive ring
+   * @param buf Given buffer to be updated by reading
+   * @param len Maximum read length
+   * @return -1 if not in async mode, else the read length
+   */
+    long long try_read(uint8_t *buf, size_t len) {
+        if (nullptr == buf || !async_)
+            return -1;
+        size_t n = async_->rx.pop(buf, len);
+        if (n > 0) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (async_->rx_full.exchange(false))
+                async_->notify();
+        }
+        return n;
+    }
+
+    /**
+   * @brief Non-blocking write into the transmit ring
+   * @param buf Given buffer to be sent
+   * @param len Send data length
+   * @return -1 if not in async mode or the I/O thread failed, else the queued length
+   */
+    long long try_write(const uint8_t *buf, size_t len) {
+        if (nullptr == buf || !is_async())
+            return -1;
+        size_t n = async_->tx.push(buf, len);
+        if (n > 0) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (async_->tx_idle.exchange(false))
+                async_->notify();
+        }
+        return n;
+    }
+
+private:
+    /**
+   * @brief State of the background I/O thread
+   */
+    struct AsyncIo {
+        AsyncIo(size_t rx_capacity, size_t tx_capacity) : rx(rx_capacity), tx(tx_capacity) {}
+
+        ~AsyncIo() {
+            if (thread.joinable()) {
+                stop.store(true, std::memory_order_release);
+                notify();
+                thread.join();
+            }
+            if (epoll_fd >= 0)
+                close(epoll_fd);
+            if (event_fd >= 0)
+                close(event_fd);
+        }
+
+        bool open(int serial_fd) {
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (epoll_fd < 0 || event_fd < 0)
+                return false;
+            /* edge triggered, so the device is only drained or filled until it would block */
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            ev.data.fd = serial_fd;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, serial_fd, &ev) != 0)
+                return false;
+            ev.events = EPOLLIN;
+            ev.data.fd = event_fd;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev) != 0)
+                return false;
+            thread = std::thread(&AsyncIo::run, this, serial_fd);
+            return true;
+        }
+
+        void notify() const {
+            uint64_t one = 1;
+            (void)::write(event_fd, &one, sizeof(one));
+        }
+
+        void run(int serial_fd) {
+            epoll_event events[2];
+            while (!stop.load(std::memory_order_acquire) && !failed.load(std::memory_order_relaxed)) {
+                service_rx(serial_fd);
+                service_tx(serial_fd);
+                int n = epoll_wait(epoll_fd, events, 2, -1);
+                for (int i = 0; i < n; ++i) {
+                    if (events[i].data.fd == event_fd) {
+                        uint64_t count;
+                        (void)::read(event_fd, &count, sizeof(count));
+                    } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                        failed.store(true, std::memory_order_release);
+                    }
+                }
+            }
+        }
+
+        void service_rx(int serial_fd) {
+            while (true) {
+                size_t len;
+                uint8_t *region = rx.write_region(len);
+                if (nullptr == region) {
+                    /* ring full, the consumer wakes us up after making room */
+                    rx_full.store(true);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (rx.size() == rx.capacity())
+                        return;
+                    rx_full.store(false);
+                    continue;
+                }
+                ssize_t r = ::read(serial_fd, region, len);
+                if (IoStats *io_stats = stats.load(std::memory_order_relaxed))
+                    io_stats->record_read(len, r);
+                if (CaptureWriter *sink = capture.load(std::memory_order_relaxed); sink && r > 0)
+                    sink->record(capture::rx, region, r);
+                if (r > 0) {
+                    rx.commit_write(r);
+                    /* a short read means the kernel buffer is drained */
+                    if ((size_t)r < len)
+                        return;
+                } else if (r < 0 && errno == EINTR) {
+                    continue;
+                } else {
+                    if (r == 0 || errno != EAGAIN)
+                        failed.store(true, std::memory_order_release);
+                    return;
+                }
+            }
+        }
+
+        void service_tx(int serial_fd) {
+            while (true) {
+                size_t len;
+                const uint8_t *region = tx.read_region(len);
+                if (nullptr == region) {
+                    /* ring empty, the producer wakes us up after queueing data */
+                    tx_idle.store(true);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (tx.empty())
+                        return;
+                    tx_idle.store(false);
+                    continue;
+                }
+                IoStats *io_stats = stats.load(std::memory_order_relaxed);
+                auto start = io_stats ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+                ssize_t r = ::write(serial_fd, region, len);
+                if (io_stats)
+                    io_stats->record_write(len, r, elapsed_ns(start));
+                if (CaptureWriter *sink = capture.load(std::memory_order_relaxed); sink && r > 0)
+                    sink->record(capture::tx, region, r);
+                if (r > 0) {
+                    tx.commit_read(r);
+                    /* a short write means the kernel buffer is full, wait for EPOLLOUT */
+                    if ((size_t)r < len)
+                        return;
+                } else if (r < 0 && errno == EINTR) {
+                    continue;
+                } else {
+                    if (r == 0 || errno != EAGAIN)
+                        failed.store(true, std::memory_order_release);
+                    return;
+                }
+            }
+        }
+
+        //! bytes received from the device, produced by the I/O thread
+        SpscRing<uint8_t> rx;
+        //! bytes to be sent to the device, consumed by the I/O thread
+        SpscRing<uint8_t> tx;
+        //! set by the I/O thread when it is waiting for room in the receive ring
+        std::atomic<bool> rx_full{false};
+        //! set by the I/O thread when it is waiting for data in the transmit ring
+        std::atomic<bool> tx_idle{false};
+        std::atomic<bool> stop{false};
+        std::atomic<bool> failed{false};
+        //! statistics of the device, null until enabled
+        std::atomic<IoStats *> stats{nullptr};
+        //! capture sink of the device, null if not capturing
+        std::atomic<CaptureWriter *> capture{nullptr};
+        int epoll_fd{-1};
+        int event_fd{-1};
+        std::thread thread;
+    };
+
+    static uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static size_t total_length(std::span<const iovec> buffers) {
+        size_t total = 0;
+        for (const auto& part : buffers)
+            total += part.iov_len;
+        return total;
+    }
+
+    /**
+   * @brief read syscall, counted in the statistics if enabled
+   */
+    ssize_t sys_read(uint8_t *buf, size_t len) {
+        ssize_t r = ::read(serial_fd_, buf, len);
+        if (stats_)
+            stats_->record_read(len, r);
+        if (capture_ && r > 0)
+            capture_->record(capture::rx, buf, r);
+        return r;
+    }
+
+    //! bytes handed to the driver per syscall of a bulk transfer
+    static constexpr size_t transfer_chunk = 1 << 16;
+
+    //! bulk transfers bypass the async thread and the write batch
+    bool begin_transfer() {
+        if (serial_fd_ < 0) {
+            errno = EBADF;
+            return false;
+        }
+        if (is_async()) {
+            errno = EBUSY;
+            return false;
+        }
+        /* batched bytes were written earlier, they go out first */
+        return flush_pending();
+    }
+
+    long long end_transfer(TransferProgress& state, const TransferCallback& progress, bool wait_drained) {
+        if (wait_drained && !drain())
+            return -1;
+        state.done = true;
+        if (progress)
+            progress(state);
+        return state.queued;
+    }
+
+    //! block until the driver takes more output
+    bool wait_writable() const {
+        pollfd serial_pollfd{serial_fd_, POLLOUT, 0};
+        while (::poll(&serial_pollfd, 1, -1) < 0) {
+            if (errno != EINTR)
+                return false;
+        }
+        if (serial_pollfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            errno = EIO;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+   * @brief write syscall, counted and timed in the statistics if enabled
+   */
+    ssize_t sys_write(const uint8_t *buf, size_t len) const {
+        ssize_t r;
+        if (!stats_) {
+            r = ::write(serial_fd_, buf, len);
+        } else {
+            auto start = std::chrono::steady_clock::now();
+            r = ::write(serial_fd_, buf, len);
+            stats_->record_write(len, r, elapsed_ns(start));
+        }
+        if (capture_ && r > 0)
+            capture_->record(capture::tx, buf, r);
+        return r;
+    }
+
+    /**
+   * @brief Capture the first n bytes of a scatter/gather transfer
+   */
+    void capture_buffers(uint8_t direction, std::span<const iovec> buffers, ssize_t n) const {
+        for (size_t i = 0; i < buffers.size() && n > 0; ++i) {
+            size_t len = std::min((size_t)n, buffers[i].iov_len);
+            capture_->record(direction, static_cast<const uint8_t *>(buffers[i].iov_base), len);
+            n -= len;
+        }
+    }
+
+    /**
+   * @brief Move bytes left over by read_until() into a buffer
+   * @return Number of bytes moved
+   */
+    size_t take_unread(uint8_t *buf, size_t len) {
+        size_t n = std::min(len, unread_.size() - unread_pos_);
+        if (n == 0)
+            return 0;
+        memcpy(buf, unread_.data() + unread_pos_, n);
+        unread_pos_ += n;
+        if (unread_pos_ == unread_.size()) {
+            unread_.clear();
+            unread_pos_ = 0;
+        }
+        return n;
+    }
+
+    /**
+   * @brief Wait for the device until an absolute deadline, robust against EINTR
+   * @param events poll events
+   * @param deadline steady clock deadline, polled once without waiting if it has passed
+   * @return Result of ppoll
+   */
+    int poll_until(short events, std::chrono::steady_clock::time_point deadline) const {
+        pollfd serial_pollfd{serial_fd_, events, 0};
+        while (true) {
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (left < 0)
+                left = 0;
+            timespec timeout_ts;
+            timeout_ts.tv_sec = left / (long long)1e9;
+            timeout_ts.tv_nsec = left % (long long)1e9;
+            int r = ppoll(&serial_pollfd, 1, &timeout_ts, NULL);
+            if (r >= 0 || errno != EINTR)
+                return r;
+        }
+    }
+
+    /**
+   * @brief Read once into buf[progress.count, len), waiting until the deadline
+   * @return False if the read should stop, progress.error tells failures from timeouts
+   */
+    bool read_some(uint8_t *buf, size_t len, std::chrono::steady_clock::time_point deadline,
+                   ReadProgress& progress) {
+        size_t want = len - progress.count;
+        if (config_.read_policy.blocking) {
+            /* never let a blocking read wait past the deadline for VMIN bytes */
+            int r = poll_until(POLLIN, deadline);
+            if (r <= 0) {
+                progress.error = r < 0 ? errno : 0;
+                return false;
+            }
+            int available = 0;
+            if (ioctl(serial_fd_, FIONREAD, &available) == 0 && available > 0)
+                want = std::min(want, (size_t)available);
+        }
+        ssize_t r = sys_read(buf + progress.count, want);
+        if (r > 0) {
+            progress.count += r;
+            return true;
+        }
+        if (r == 0) {
+            progress.error = EIO;
+            return false;
+        }
+        if (errno == EINTR)
+            return true;
+        if (errno != EAGAIN) {
+            progress.error = errno;
+            return false;
+        }
+        int p = poll_until(POLLIN, deadline);
+        if (p <= 0) {
+            progress.error = p < 0 ? errno : 0;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+   * @brief Buffer of coalesced writes
+   */
+    struct WriteBatch {
+        WriteBatch(size_t capacity, long long delay) : data(new uint8_t[capacity]),
+                                                       capacity(capacity),
+                                                       delay(delay) {}
+
+        void append(const uint8_t *buf, size_t len) {
+            if (size == 0)
+                deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(delay);
+            memcpy(data.get() + size, buf, len);
+            size += len;
+        }
+
+        void consume(size_t len) {
+            memmove(data.get(), data.get() + len, size - len);
+            size -= len;
+        }
+
+        //! nanoseconds until the batch is due, -1 if empty
+        long long time_left() const {
+            if (size == 0)
+                return -1;
+            auto left = deadline - std::chrono::steady_clock::now();
+            return std::max<long long>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(left).count());
+        }
+
+        std::unique_ptr<uint8_t[]> data;
+        size_t capacity;
+        size_t size{0};
+        long long delay;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    long long write_batched(const uint8_t *buf, size_t len) {
+        if (nullptr == buf)
+            return -1;
+        if (batch_->size + len > batch_->capacity) {
+            if (flush() < 0)
+                return -1;
+            /* the device did not take the whole batch, queue what fits */
+            if (batch_->size + len > batch_->capacity && batch_->size > 0)
+                len = batch_->capacity - batch_->size;
+        }
+        if (batch_->size == 0 && len >= batch_->capacity)
+            return sys_write(buf, len);
+        batch_->append(buf, len);
+        if ((batch_->size == batch_->capacity || batch_->time_left() == 0) && flush() < 0)
+            return -1;
+        return len;
+    }
+
+    /**
+   * @brief Write out the whole pending batch, waiting for the driver to take more output
+   * @return True if nothing is pending anymore
+   */
+    bool flush_pending() {
+        while (pending_write() > 0) {
+            if (flush() < 0)
+                return false;
+            if (pending_write() > 0 && !wait_writable())
+                return false;
+        }
+        return true;
+    }
+
+    /**
+   * @brief Open the serial device
+   * @return True if open successfully
+   */
+    bool open_device() {
+        serial_fd_ = open(port_name_.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (serial_fd_ < 0)
+            return false;
+        return true;
+    }
+
+    /**
+   * @brief Close the serial device
+   * @return True if close successfully
+   */
+    bool close_device() {
+        if (serial_fd_ < 0)
+            return true;
+        tcsetattr(serial_fd_, TCSANOW, &old_termios_);
+        close(serial_fd_);
+        serial_fd_ = -1;
+        return true;
+    }
+
+    /**
+   * @brief Stop async mode, write out the pending batch and close the device
+   */
+    void release() {
+        stop_async();
+        if (serial_fd_ >= 0)
+            flush_pending();
+        batch_.reset();
+        close_device();
+    }
+
+    /**
+   * @brief Configure the device
+   * @return True if configure successfully
+   */
+    bool config_device() {
+        /* save current port parameter */
+        if (tcgetattr(serial_fd_, &old_termios_) != 0) {
+            return false;
+        }
+        /* new_termios_ is built once from the config, so a reconnect reuses it */
+        /* flush the hardware fifo */
+        tcflush(serial_fd_, TCIFLUSH);
+        /* activite the configuration */
+        if (!apply_termios() || !set_blocking(config_.read_policy.blocking))
+            return false;
+        /* make sure the driver did not fall back to another rate */
+        if (!verify_baudrate(config_.baudrate))
+            return false;
+        /* low latency mode, not every driver supports it */
+        set_low_latency(true);
+        return true;
+    }
+
+    /**
+   * @brief Set or clear the ASYNC_LOW_LATENCY flag of the driver
+   * @return True if the flag reads back as requested
+   */
+    bool set_low_latency(bool enable) {
+        struct serial_struct kernel_serial_settings{};
+        if (ioctl(serial_fd_, TIOCGSERIAL, &kernel_serial_settings) != 0)
+            return false;
+        if (enable)
+            kernel_serial_settings.flags |= ASYNC_LOW_LATENCY;
+        else
+            kernel_serial_settings.flags &= ~ASYNC_LOW_LATENCY;
+        if (ioctl(serial_fd_, TIOCSSERIAL, &kernel_serial_settings) != 0 ||
+            ioctl(serial_fd_, TIOCGSERIAL, &kernel_serial_settings) != 0)
+            return false;
+        return (bool)(kernel_serial_settings.flags & ASYNC_LOW_LATENCY) == enable;
+    }
+
+    /**
+   * @brief Get the sysfs latency_timer attribute of a usb-serial adapter
+   * @return Path of the attribute, i.e. /sys/class/tty/ttyUSB0/device/latency_timer
+   */
+    std::string latency_timer_path() const {
+        std::error_code ec;
+        std::filesystem::path device = std::filesystem::canonical(port_name_, ec);
+        if (ec)
+            device = port_name_;
+        return "/sys/class/tty/" + device.filename().string() + "/device/latency_timer";
+    }
+
+    /**
+   * @brief Activate new_termios_, through termios2 if the baudrate has no speed constant
+   * @return True if success
+   */
+    bool apply_termios() {
+        if (standard_speed(config_.baudrate) != B0)
+            return tcsetattr(serial_fd_, TCSANOW, &new_termios_) == 0;
+        return set_custom_baudrate(config_.baudrate);
+    }
+
+    /**
+   * @brief Switch the device between blocking and non-blocking reads
+   * @param blocking True to clear O_NONBLOCK
+   * @return True if success
+   */
+    bool set_blocking(bool blocking) {
+        int flags = fcntl(serial_fd_, F_GETFL);
+        if (flags < 0)
+            return false;
+        flags = blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK;
+        return fcntl(serial_fd_, F_SETFL, flags) == 0;
+    }
+
+    /**
+   * @brief Wait for the first byte according to the total deadline of the read policy
+   * @return True if data is available
+   */
+    bool wait_policy() {
+        pollfd serial_pollfd{serial_fd_, POLLIN, 0};
+        timespec timeout_ts;
+        timeout_ts.tv_sec = config_.read_policy.timeout / (long long)1e9;
+        timeout_ts.tv_nsec = config_.read_policy.timeout % (long long)1e9;
+        return ppoll(&serial_pollfd, 1, &timeout_ts, NULL) > 0;
+    }
+
+    /**
+   * @brief Apply the configuration with an arbitrary baudrate through termios2
+   * @param baudrate serial baudrate
+   * @return True if the driver accepted the configuration
+   */
+    bool set_custom_baudrate(int baudrate) {
+#ifdef SERIAL_LITE_HAS_TERMIOS2
+        if (baudrate <= 0)
+            return false;
+        termios2 tio{};
+        tio.c_iflag = new_termios_.c_iflag;
+        tio.c_oflag = new_termios_.c_oflag;
+        tio.c_cflag = (new_termios_.c_cflag & ~CBAUD) | termios2_bother;
+        tio.c_lflag = new_termios_.c_lflag;
+        tio.c_line = new_termios_.c_line;
+        memcpy(tio.c_cc, new_termios_.c_cc, sizeof(tio.c_cc));
+        tio.c_ispeed = baudrate;
+        tio.c_ospeed = baudrate;
+        return ioctl(serial_fd_, termios2_set, &tio) == 0;
+#else
+        (void)baudrate;
+        return false;
+#endif
+    }
+
+    /**
+   * @brief Check the baudrate the driver actually runs at
+   * @param baudrate requested baudrate
+   * @return True if the actual baudrate is within 2% of the requested one
+   */
+    bool verify_baudrate(int baudrate) const {
+#ifdef SERIAL_LITE_HAS_TERMIOS2
+        termios2 tio{};
+        if (ioctl(serial_fd_, termios2_get, &tio) == 0) {
+            long long diff = (long long)tio.c_ospeed - baudrate;
+            return diff * 50 <= baudrate && -diff * 50 <= baudrate;
+        }
+#endif
+        struct termios current;
+        if (tcgetattr(serial_fd_, &current) != 0)
+            return false;
+        return standard_speed(baudrate) != B0 && cfgetospeed(&current) == standard_speed(baudrate);
+    }
+
+    //! port name of the serial device
+    std::string port_name_;
+    //! line settings of the serial device
+    SerialConfig config_;
+    //! serial handler, -1 while the device is not open
+    int serial_fd_{-1};
+    //! termios config for serial handler
+    struct termios new_termios_{}, old_termios_{};
+    //! bytes received after the delimiter of read_until(), served first by the next read
+    std::vector<uint8_t> unread_;
+    size_t unread_pos_{0};
+    //! coalesced writes, only present in batching mode
+    std::unique_ptr<WriteBatch> batch_;
+    //! background I/O thread, only present in async mode
+    std::unique_ptr<AsyncIo> async_;
+    //! ring sizes of async mode, restored by reopen()
+    size_t async_rx_capacity_{0};
+    size_t async_tx_capacity_{0};
+    //! last latency settings, restored by reopen()
+    std::optional<LatencySettings> latency_;
+    //! I/O statistics, only present once enabled
+    std::unique_ptr<IoStats> stats_;
+    //! capture sink, not owned
+    CaptureWriter *capture_{nullptr};
+};
+
+/**
+ * @brief epoll based reactor dispatching readiness of many serial devices from one thread
+ */
+class SerialPoller {
+public:
+    //! readiness callback, receives the ready device and the epoll event mask
+    using Callback = std::function<void(Serial&, uint32_t)>;
+
+    /**
+   * @brief Constructor of poller
+   * @param max_events maximum number of events dispatched per epoll_wait call
+   */
+    explicit SerialPoller(size_t max_events = 64) : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+                                                    events_(max_events ? max_events : 1) {}
+
+    /**
+   * @brief Destructor of poller, the registered devices are left open
+   */
+    ~SerialPoller() {
+        if (epoll_fd_ >= 0)
+            close(epoll_fd_);
+    }
+
+    SerialPoller(const SerialPoller&) = delete;
+    SerialPoller& operator=(const SerialPoller&) = delete;
+
+    /**
+   * @brief Register an initialized device, edge triggered
+   * @param serial Device to be watched, must outlive the registration
+   * @param callback Called with the device when it becomes ready, should drain it until EAGAIN
+   * @param events epoll events of interest
+   * @return True if success
+   */
+    bool add(Serial& serial, Callback callback, uint32_t events = EPOLLIN) {
+        if (epoll_fd_ < 0 || serial.native_handle() < 0 || !callback)
+            return false;
+        std::unique_ptr<Entry> entry(new Entry{&serial, std::move(callback)});
+        epoll_event ev{};
+        ev.events = events | EPOLLET;
+        ev.data.ptr = entry.get();
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, serial.native_handle(), &ev) != 0)
+            return false;
+        entries_.emplace_back(std::move(entry));
+        return true;
+    }
+
+    /**
+   * @brief Unregister a device, safe to call from a callback
+   * @param serial Device to be removed
+   * @return True if the device was registered
+   */
+    bool remove(Serial& serial) {
+        for (auto& entry : entries_) {
+            if (entry->serial == &serial) {
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, serial.native_handle(), nullptr);
+                entry->serial = nullptr;
+                removed_ = true;
+                if (!dispatching_)
+                    collect();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t size() const {
+        size_t n = 0;
+        for (const auto& entry : entries_)
+            n += entry->serial != nullptr;
+        return n;
+    }
+
+    /**
+   * @brief Wait for readiness and dispatch the callbacks of a batch of ready devices
+   * @param nanosecond Timeout in nanosecond, negative to wait forever
+   * @return -1 if failed, else the number of dispatched callbacks
+   */
+    int poll(long long nanosecond) {
+        int timeout_ms = nanosecond < 0 ? -1 : (int)std::min<long long>((nanosecond + 999999) / 1000000, INT32_MAX);
+        int n = epoll_wait(epoll_fd_, events_.data(), (int)events_.size(), timeout_ms);
+        if (n < 0)
+            return errno == EINTR ? 0 : -1;
+        int dispatched = 0;
+        dispatching_ = true;
+        for (int i = 0; i < n; ++i) {
+            Entry *entry = static_cast<Entry *>(events_[i].data.ptr);
+            if (entry->serial != nullptr) {
+                entry->callback(*entry->serial, events_[i].events);
+                ++dispatched;
+            }
+        }
+        dispatching_ = false;
+        if (removed_)
+            collect();
+        return dispatched;
+    }
+
+private:
+    struct Entry {
+        Serial *serial;
+        Callback callback;
+    };
+
+    void collect() {
+        entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+                                      [](const std::unique_ptr<Entry>& entry) { return entry->serial == nullptr; }),
+                       entries_.end());
+        removed_ = false;
+    }
+
+    //! epoll handler shared by all devices
+    int epoll_fd_;
+    //! preallocated event batch
+    std::vector<epoll_event> events_;
+    //! registered devices, stable addresses are handed to epoll
+    std::vector<std::unique_ptr<Entry>> entries_;
+    bool dispatching_{false};
+    bool removed_{false};
+};
+
+/**
+ * @brief Identity of a usb-serial adapter which survives reenumeration under another name
+ */
+struct DeviceIdentity {
+    unsigned short vendor_id{};
+    unsigned short product_id{};
+    //! USB serial number, empty if the adapter has none
+    std::string serial_number;
+    //! device path an adapter without serial number must reappear under, empty to match any adapter with the ids
+    std::string port_path;
+
+    /**
+     * @brief Get the identity of an enumerated device
+     * @note Adapters without a serial number are told apart by their device path, so that
+     * another adapter with the same ids, which may be in use, is not taken for this one
+     */
+    static DeviceIdentity of(const SerialInfo& info) {
+        return DeviceIdentity{info.vendor_id, info.product_id, info.serial_number,
+                              info.serial_number.empty() ? info.port_path : std::string()};
+    }
+
+    bool matches(const SerialInfo& info) const {
+        if (info.vendor_id != vendor_id || info.product_id != product_id)
+            return false;
+        if (!serial_number.empty())
+            return info.serial_number == serial_number;
+        return port_path.empty() || info.port_path == port_path;
+    }
+};
+
+/**
+ * @brief Reconnect serial devices whose usb adapter was unplugged and plugged in again
+ * @note process_events() has to be called from the thread using the attached devices
+ */
+class SerialReconnector {
+public:
+    //! called with true after the device was reopened, false after it went away
+    using Callback = std::function<void(Serial&, bool)>;
+
+    SerialReconnector() {
+        registry_.on_change([this](const SerialInfo& info, bool added) {
+            if (!added)
+                removed(info);
+        });
+    }
+
+    SerialReconnector(const SerialReconnector&) = delete;
+    SerialReconnector& operator=(const SerialReconnector&) = delete;
+
+    /**
+     * @brief Watch a device, reopened under whatever name the same adapter reappears as
+     * @param serial Device to be watched
+     * @param identity Adapter identity, i.e. DeviceIdentity::of(info)
+     * @param callback Called on disconnect and reconnect
+     */
+    void attach(Serial& serial, const DeviceIdentity& identity, Callback callback = nullptr) {
+        detach(serial);
+        watches_.push_back(Watch{&serial, identity, std::move(callback), kernel_name(serial.port_name())});
+    }
+
+    /**
+     * @brief Watch a device by the identity of the adapter it is currently open on
+     * @return False if the port is not a known usb-serial adapter
+     */
+    bool attach(Serial& serial, Callback callback = nullptr) {
+        const SerialInfo *info = registry_.find(kernel_name(serial.port_name()));
+        if (info == nullptr || (info->vendor_id == 0 && info->product_id == 0))
+            return false;
+        attach(serial, DeviceIdentity::of(*info), std::move(callback));
+        return true;
+    }
+
+    void detach(Serial& serial) {
+        watches_.erase(std::remove_if(watches_.begin(), watches_.end(),
+                                      [&](const Watch& w) { return w.serial == &serial; }),
+                       watches_.end());
+    }
+
+    /**
+     * @brief Apply pending hotplug events, disconnect removed and reopen reappeared devices
+     * @return Number of devices reopened
+     * @note Devices which failed to reopen, i.e. before udev applied the permissions, are retried on each call
+     */
+    size_t process_events() {
+        registry_.process_events();
+        size_t reopened = 0;
+        for (Watch& w : watches_) {
+            if (w.serial->is_open())
+                continue;
+            for (const SerialInfo& info : registry_.list_port()) {
+                if (w.identity.matches(info) && w.serial->reopen(info.port_path)) {
+                    w.device_name = info.port_name;
+                    ++reopened;
+                    if (w.callback)
+                        w.callback(*w.serial, true);
+                    break;
+                }
+            }
+        }
+        return reopened;
+    }
+
+    /**
+     * @brief Get the netlink socket, readable when hotplug events are pending
+     * @return File descriptor, -1 if hotplug events are unavailable
+     */
+    int native_handle() const {
+        return registry_.native_handle();
+    }
+
+    //! device registry the reconnector is driven by
+    const SerialRegistry& registry() const {
+        return registry_;
+    }
+
+private:
+    struct Watch {
+        Serial *serial;
+        DeviceIdentity identity;
+        Callback callback;
+        //! kernel name of the device, i.e. ttyUSB0 behind a /dev/serial/by-id link
+        std::string device_name;
+    };
+
+    /**
+     * @brief Resolve symlinks like /dev/serial/by-id/... to the kernel device name
+     */
+    static std::string kernel_name(const std::string& port_name) {
+        std::error_code ec;
+        std::filesystem::path device = std::filesystem::canonical(port_name, ec);
+        return (ec ? std::filesystem::path(port_name) : device).filename().string();
+    }
+
+    void removed(const SerialInfo& info) {
+        for (Watch& w : watches_) {
+            if (w.serial->is_open() && w.device_name == info.port_name) {
+                w.serial->disconnect();
+                if (w.callback)
+                    w.callback(*w.serial, false);
+            }
+        }
+    }
+
+    SerialRegistry registry_;
+    std::vector<Watch> watches_;
+};
+
+#ifdef SERIAL_LITE_HAS_IO_URING
+/**
+ * @brief io_uring backend servicing reads and writes of many serial devices with one syscall
+ * @note Reads use multishot reads into a registered buffer ring (Linux 6.7), falling back to
+ * single shot reads with buffer selection (Linux 5.19)
+ */
+class SerialUring {
+public:
+    //! called with received bytes, the span is valid during the call only; an empty span means the read failed
+    using ReadCallback = std::function<void(Serial&, std::span<const uint8_t>)>;
+    //! called when a queued write completed, with the buffer given to write() and -1 or the written length
+    using WriteCallback = std::function<void(Serial&, const uint8_t *, long long)>;
+
+    /**
+   * @brief Constructor of io_uring backend, all rings and buffers are allocated here
+   * @param entries submission queue size, bounds the number of writes in flight
+   * @param buffer_count number of receive buffers, rounded up to a power of two
+   * @param buffer_size size of each receive buffer
+   */
+    explicit SerialUring(unsigned entries = 256, unsigned buffer_count = 256, unsigned buffer_size = 4096)
+        : buffer_size_(buffer_size) {
+        io_uring_params params{};
+        params.flags = IORING_SETUP_CLAMP;
+        ring_fd_ = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (ring_fd_ < 0)
+            return;
+        if (!map_rings(params) || !setup_buffers(buffer_count)) {
+            release();
+            return;
+        }
+        writes_.resize(params.sq_entries);
+        for (auto& op : writes_)
+            free_writes_.push_back(&op);
+    }
+
+    ~SerialUring() {
+        release();
+    }
+
+    SerialUring(const SerialUring&) = delete;
+    SerialUring& operator=(const SerialUring&) = delete;
+
+    /**
+   * @brief Check whether the kernel supports the backend
+   */
+    bool ok() const {
+        return ring_fd_ >= 0;
+    }
+
+    /**
+   * @brief Register an initialized device and arm its read
+   * @param serial Device to be serviced, must stay in place until remove()
+   * @param on_read Called with received bytes
+   * @param on_write Called when a write of this device completed
+   * @return False if failed or already registered
+   */
+    bool add(Serial& serial, ReadCallback on_read, WriteCallback on_write = {}) {
+        if (!ok() || serial.native_handle() < 0 || !on_read || find(serial) != nullptr)
+            return false;
+        ports_.emplace_back(new Port{&serial, std::move(on_read), std::move(on_write), false});
+        if (!arm_read(ports_.back().get())) {
+            ports_.pop_back();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+   * @brief Unregister a device, its read and writes are cancelled with IORING_OP_ASYNC_CANCEL
+   * @param serial Registered device, before it is moved or destroyed
+   * @return False if the device is not registered or the ring failed
+   * @note Blocks until the kernel released all operations of the device, completions of other
+   * devices may be dispatched meanwhile. Writes not finished complete with -1.
+   */
+    bool remove(Serial& serial) {
+        Port *port = find(serial);
+        if (port == nullptr)
+            return false;
+        port->removed = true;
+        uint64_t read = reinterpret_cast<uint64_t>(port);
+        if (!cancel(read) || !cancel(read | poll_tag))
+            return false;
+        for (WriteOp& op : writes_) {
+            uint64_t write = reinterpret_cast<uint64_t>(&op) | write_tag;
+            if (op.port == port && (!cancel(write) || !cancel(write | poll_tag)))
+                return false;
+        }
+        while (port->in_flight > 0) {
+            if (poll(-1) < 0)
+                return false;
+        }
+        std::erase_if(ports_, [port](const std::unique_ptr<Port>& p) { return p.get() == port; });
+        return true;
+    }
+
+    /**
+   * @brief Queue a write, submitted together with other queued operations by the next poll()
+   * @param serial Registered device
+   * @param buf Given buffer to be sent, must stay valid until the write callback
+   * @param len Send data length
+   * @return False if the device is not registered or too many writes are in flight
+   */
+    bool write(Serial& serial, const uint8_t *buf, size_t len) {
+        Port *port = find(serial);
+        if (port == nullptr || nullptr == buf || free_writes_.empty())
+            return false;
+        WriteOp *op = free_writes_.back();
+        free_writes_.pop_back();
+        *op = WriteOp{port, buf, len, 0};
+        if (!submit_write(op)) {
+            op->port = nullptr;
+            free_writes_.push_back(op);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+   * @brief Submit queued operations and dispatch completions, one io_uring_enter per call
+   * @param nanosecond Timeout in nanosecond, negative to wait forever, 0 to only reap
+   * @return -1 if failed, else the number of processed completions
+   */
+    int poll(long long nanosecond) {
+        if (!ok())
+            return -1;
+        unsigned submit = pending_submit_;
+        pending_submit_ = 0;
+        unsigned flags = IORING_ENTER_GETEVENTS;
+        io_uring_getevents_arg arg{};
+        __kernel_timespec ts{};
+        if (nanosecond >= 0) {
+            ts.tv_sec = nanosecond / (long long)1e9;
+            ts.tv_nsec = nanosecond % (long long)1e9;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+        long r = syscall(__NR_io_uring_enter, ring_fd_, submit, ready() ? 0 : 1, flags,
+                         nanosecond >= 0 ? (void *)&arg : nullptr, nanosecond >= 0 ? sizeof(arg) : 0);
+        if (r < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+            return -1;
+        return reap();
+    }
+
+private:
+    struct Port {
+        Serial *serial;
+        ReadCallback on_read;
+        WriteCallback on_write;
+        //! multishot read was rejected by the kernel
+        bool single_shot;
+        //! remove() is waiting for the operations in flight
+        bool removed{false};
+        //! armed read and queued writes the kernel has not completed
+        unsigned in_flight{0};
+    };
+
+    struct WriteOp {
+        //! null while the entry is free
+        Port *port;
+        const uint8_t *buf;
+        size_t len;
+        size_t done;
+    };
+
+    //! IORING_OP_READ_MULTISHOT, missing from older kernel headers
+    static constexpr uint8_t op_read_multishot = 49;
+    //! buffer group of the receive buffer ring
+    static constexpr uint16_t buffer_group = 0;
+    //! tag in the low bits of user_data telling writes from reads
+    static constexpr uint64_t write_tag = 1;
+    //! tag of the readiness poll linked before a read or write, its completion is ignored
+    static constexpr uint64_t poll_tag = 2;
+
+    bool map_rings(const io_uring_params& params) {
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        sq_ring_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED)
+            return (sq_ring_ = nullptr), false;
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED)
+                return (cq_ring_ = nullptr), false;
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            return false;
+        sqes_ = static_cast<io_uring_sqe *>(sqes);
+        auto *sq = static_cast<uint8_t *>(sq_ring_);
+        auto *cq = static_cast<uint8_t *>(cq_ring_);
+        sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+        cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    bool setup_buffers(unsigned count) {
+        buffer_count_ = 1;
+        while (buffer_count_ < count && buffer_count_ < 32768)
+            buffer_count_ <<= 1;
+        buf_ring_size_ = buffer_count_ * sizeof(io_uring_buf);
+        void *ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED)
+            return false;
+        buf_ring_ = static_cast<io_uring_buf_ring *>(ring);
+        buffers_.reset(new uint8_t[(size_t)buffer_count_ * buffer_size_]);
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+        reg.ring_entries = buffer_count_;
+        reg.bgid = buffer_group;
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+            return false;
+        for (unsigned bid = 0; bid < buffer_count_; ++bid)
+            add_buffer(bid, bid);
+        publish_buffers(buffer_count_);
+        return true;
+    }
+
+    void add_buffer(unsigned bid, unsigned offset) {
+        io_uring_buf& buf = buf_ring_->bufs[(buf_tail_ + offset) & (buffer_count_ - 1)];
+        buf.addr = reinterpret_cast<uint64_t>(buffers_.get() + (size_t)bid * buffer_size_);
+        buf.len = buffer_size_;
+        buf.bid = (uint16_t)bid;
+    }
+
+    void publish_buffers(unsigned count) {
+        buf_tail_ += count;
+        ring_buffers_ += count;
+        std::atomic_ref<uint16_t>(buf_ring_->tail).store((uint16_t)buf_tail_, std::memory_order_release);
+    }
+
+    /**
+   * @brief Give a consumed receive buffer back to the kernel
+   */
+    void recycle_buffer(unsigned bid, unsigned& recycled) {
+        if (!provide_buffers_) {
+            add_buffer(bid, recycled++);
+            return;
+        }
+        provide(bid, 1);
+    }
+
+    /**
+   * @brief Hand buffers over with IORING_OP_PROVIDE_BUFFERS
+   */
+    bool provide(unsigned bid, unsigned count) {
+        io_uring_sqe *sqe = get_sqe();
+        if (sqe == nullptr)
+            return false;
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = (int)count;
+        sqe->addr = reinterpret_cast<uint64_t>(buffers_.get() + (size_t)bid * buffer_size_);
+        sqe->len = buffer_size_;
+        sqe->off = bid;
+        sqe->buf_group = buffer_group;
+        sqe->user_data = 0;
+        push_sqe();
+        return true;
+    }
+
+    /**
+   * @brief Replace the buffer ring by provided buffers, for kernels which do not take buffers from the ring
+   */
+    void fall_back_to_provided_buffers() {
+        io_uring_buf_reg reg{};
+        reg.bgid = buffer_group;
+        syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        provide_buffers_ = true;
+        provide(0, buffer_count_);
+    }
+
+    void release() {
+        if (buf_ring_ != nullptr)
+            munmap(buf_ring_, buf_ring_size_);
+        if (sqes_ != nullptr)
+            munmap(sqes_, sqes_size_);
+        if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+            munmap(cq_ring_, cq_size_);
+        if (sq_ring_ != nullptr)
+            munmap(sq_ring_, sq_size_);
+        if (ring_fd_ >= 0)
+            close(ring_fd_);
+        buf_ring_ = nullptr;
+        sqes_ = nullptr;
+        cq_ring_ = sq_ring_ = nullptr;
+        ring_fd_ = -1;
+    }
+
+    Port *find(Serial& serial) const {
+        for (const auto& port : ports_) {
+            if (port->serial == &serial && !port->removed)
+                return port.get();
+        }
+        return nullptr;
+    }
+
+    //! @param count number of SQEs that must fit, the following count - 1 calls succeed without a syscall
+    io_uring_sqe *get_sqe(unsigned count = 1) {
+        unsigned tail = *sq_tail_;
+        if (tail - std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire) + count > sq_entries_) {
+            /* queue full, hand it to the kernel first */
+            syscall(__NR_io_uring_enter, ring_fd_, pending_submit_, 0, 0, nullptr, 0);
+            pending_submit_ = 0;
+            if (tail - std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire) + count > sq_entries_)
+                return nullptr;
+        }
+        io_uring_sqe *sqe = &sqes_[tail & sq_mask_];
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array_[tail & sq_mask_] = tail & sq_mask_;
+        return sqe;
+    }
+
+    void push_sqe() {
+        std::atomic_ref<unsigned>(*sq_tail_).store(*sq_tail_ + 1, std::memory_order_release);
+        ++pending_submit_;
+    }
+
+    /**
+   * @brief Queue a readiness poll linked to the next SQE
+   * @note The devices are O_NONBLOCK, so io_uring fails their reads and writes with EAGAIN
+   * instead of waiting; the linked operation only starts once the poll fired
+   */
+    void link_poll(io_uring_sqe *sqe, int fd, unsigned events, uint64_t user_data) {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = events;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = user_data | poll_tag;
+        push_sqe();
+    }
+
+    //! cancel the operation queued with user_data, a completion of the cancel itself is ignored
+    bool cancel(uint64_t user_data) {
+        io_uring_sqe *sqe = get_sqe();
+        if (sqe == nullptr)
+            return false;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = user_data;
+        sqe->user_data = 0;
+        push_sqe();
+        return true;
+    }
+
+    //! @param wait wait for POLLIN first, after a single shot read failed with EAGAIN
+    bool arm_read(Port *port, bool wait = false) {
+        io_uring_sqe *sqe = get_sqe(wait ? 2 : 1);
+        if (sqe == nullptr)
+            return false;
+        if (wait) {
+            link_poll(sqe, port->serial->native_handle(), POLLIN, reinterpret_cast<uint64_t>(port));
+            sqe = get_sqe();
+        }
+        sqe->opcode = port->single_shot ? (uint8_t)IORING_OP_READ : op_read_multishot;
+        sqe->fd = port->serial->native_handle();
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = buffer_group;
+        sqe->len = port->single_shot ? buffer_size_ : 0;
+        sqe->off = (uint64_t)-1;
+        sqe->user_data = reinterpret_cast<uint64_t>(port);
+        push_sqe();
+        ++port->in_flight;
+        return true;
+    }
+
+    //! @param wait wait for POLLOUT first, after the write failed with EAGAIN
+    bool submit_write(WriteOp *op, bool wait = false) {
+        io_uring_sqe *sqe = get_sqe(wait ? 2 : 1);
+        if (sqe == nullptr)
+            return false;
+        if (wait) {
+            link_poll(sqe, op->port->serial->native_handle(), POLLOUT, reinterpret_cast<uint64_t>(op) | write_tag);
+            sqe = get_sqe();
+        }
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = op->port->serial->native_handle();
+        sqe->addr = reinterpret_cast<uint64_t>(op->buf + op->done);
+        sqe->len = (unsigned)(op->len - op->done);
+        sqe->off = (uint64_t)-1;
+        sqe->user_data = reinterpret_cast<uint64_t>(op) | write_tag;
+        push_sqe();
+        ++op->port->in_flight;
+        return true;
+    }
+
+    bool ready() const {
+        return *cq_head_ != std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+    }
+
+    int reap() {
+        int processed = 0;
+        unsigned head = *cq_head_;
+        unsigned recycled = 0;
+        while (head != std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire)) {
+            io_uring_cqe cqe = cqes_[head & cq_mask_];
+            std::atomic_ref<unsigned>(*cq_head_).store(++head, std::memory_order_release);
+            ++processed;
+            if (cqe.user_data == 0 || (cqe.user_data & poll_tag))
+                continue;
+            if (cqe.user_data & write_tag)
+                complete_write(reinterpret_cast<WriteOp *>(cqe.user_data & ~write_tag), cqe.res);
+            else
+                complete_read(reinterpret_cast<Port *>(cqe.user_data), cqe, recycled);
+        }
+        if (recycled > 0 && !provide_buffers_)
+            publish_buffers(recycled);
+        return processed;
+    }
+
+    void complete_read(Port *port, const io_uring_cqe& cqe, unsigned& recycled) {
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            --ring_buffers_;
+            if (cqe.res > 0 && !port->removed)
+                port->on_read(*port->serial, std::span<const uint8_t>(buffers_.get() + (size_t)bid * buffer_size_, cqe.res));
+            recycle_buffer(bid, recycled);
+        }
+        if (cqe.flags & IORING_CQE_F_MORE)
+            return;
+        --port->in_flight;
+        if (port->removed)
+            return;
+        bool wait = false;
+        if (cqe.res == -ENOBUFS && !provide_buffers_ && ring_buffers_ + recycled == buffer_count_) {
+            /* the ring is full from our side, yet the kernel found no buffer */
+            ring_buffers_ += recycled;
+            recycled = 0;
+            fall_back_to_provided_buffers();
+        } else if (cqe.res == -EINVAL && !port->single_shot) {
+            /* kernel without multishot reads */
+            port->single_shot = true;
+        } else if (cqe.res == -EAGAIN) {
+            /* nothing to read yet, re-arming right away would spin through the ring */
+            wait = true;
+        } else if (cqe.res <= 0 && cqe.res != -ENOBUFS && cqe.res != -EINTR) {
+            port->on_read(*port->serial, {});
+            return;
+        }
+        arm_read(port, wait);
+    }
+
+    void complete_write(WriteOp *op, int res) {
+        --op->port->in_flight;
+        if (res > 0)
+            op->done += res;
+        if (!op->port->removed) {
+            if (res > 0 && op->done < op->len && submit_write(op))
+                return;
+            if ((res == -EAGAIN || res == -EINTR) && submit_write(op, res == -EAGAIN))
+                return;
+        }
+        WriteOp done = *op;
+        op->port = nullptr;
+        free_writes_.push_back(op);
+        if (done.port->on_write)
+            done.port->on_write(*done.port->serial, done.buf, done.done == done.len ? (long long)done.len : -1);
+    }
+
+    int ring_fd_{-1};
+    void *sq_ring_{nullptr};
+    void *cq_ring_{nullptr};
+    size_t sq_size_{0};
+    size_t cq_size_{0};
+    size_t sqes_size_{0};
+    io_uring_sqe *sqes_{nullptr};
+    unsigned *sq_head_{nullptr};
+    unsigned *sq_tail_{nullptr};
+    unsigned *sq_array_{nullptr};
+    unsigned sq_mask_{0};
+    unsigned sq_entries_{0};
+    unsigned *cq_head_{nullptr};
+    unsigned *cq_tail_{nullptr};
+    unsigned cq_mask_{0};
+    io_uring_cqe *cqes_{nullptr};
+    //! SQEs queued since the last io_uring_enter
+    unsigned pending_submit_{0};
+    //! registered receive buffer ring
+    io_uring_buf_ring *buf_ring_{nullptr};
+    size_t buf_ring_size_{0};
+    unsigned buf_tail_{0};
+    //! buffers published to the ring and not consumed yet
+    unsigned ring_buffers_{0};
+    //! buffers are handed over with IORING_OP_PROVIDE_BUFFERS instead of the ring
+    bool provide_buffers_{false};
+    unsigned buffer_count_{0};
+    unsigned buffer_size_;
+    std::unique_ptr<uint8_t[]> buffers_;
+    //! registered devices, stable addresses are used as user_data
+    std::vector<std::unique_ptr<Port>> ports_;
+    //! preallocated pending write table
+    std::vector<WriteOp> writes_;
+    std::vector<WriteOp *> free_writes_;
+};
+#endif
+
+class FramePool;
+
+/**
+ * @brief Refcounted handle to a frame buffer of a FramePool, copies share the buffer
+ * @note The buffer goes back to the pool when the last handle is destroyed, on any thread.
+ * Handles must not outlive their pool.
+ */
+class PooledFrame {
+public:
+    PooledFrame() = default;
+
+    PooledFrame(const PooledFrame& other) : slab_(other.slab_), index_(other.index_) {
+        if (slab_ != nullptr)
+            slot().refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    PooledFrame(PooledFrame&& other) noexcept : slab_(std::exchange(other.slab_, nullptr)), index_(other.index_) {}
+
+    PooledFrame& operator=(PooledFrame other) noexcept {
+        std::swap(slab_, other.slab_);
+        std::swap(index_, other.index_);
+        return *this;
+    }
+
+    ~PooledFrame() {
+        reset();
+    }
+
+    /**
+   * @brief Drop this reference, the buffer is recycled if it was the last one
+   */
+    inline void reset();
+
+    explicit operator bool() const {
+        return slab_ != nullptr;
+    }
+
+    inline const uint8_t *data() const;
+
+    size_t size() const {
+        return slab_ != nullptr ? slot().length : 0;
+    }
+
+    inline size_t capacity() const;
+
+    std::span<const uint8_t> span() const {
+        return std::span<const uint8_t>(data(), size());
+    }
+
+    /**
+   * @brief Get the whole buffer for filling, only while this handle is not shared
+   */
+    inline std::span<uint8_t> writable();
+
+    /**
+   * @brief Set the length of the frame after filling writable()
+   * @param len Frame length, clamped to capacity()
+   */
+    void resize(size_t len) {
+        if (slab_ != nullptr)
+            slot().length = std::min(len, capacity());
+    }
+
+    //! number of handles sharing the buffer
+    uint32_t use_count() const {
+        return slab_ != nullptr ? slot().refs.load(std::memory_order_relaxed) : 0;
+    }
+
+private:
+    friend class FramePool;
+
+    struct Slab;
+
+    struct Slot {
+        std::atomic<uint32_t> refs{0};
+        uint32_t length{0};
+        //! next free slot while the slot is in a free list
+        std::atomic<uint32_t> next{0};
+    };
+
+    PooledFrame(Slab *slab, uint32_t index) : slab_(slab), index_(index) {}
+
+    inline Slot& slot() const;
+
+    Slab *slab_{nullptr};
+    uint32_t index_{0};
+};
+
+/**
+ * @brief Frame storage and free list, shared by a FramePool and the thread caches holding its buffers
+ */
+struct PooledFrame::Slab {
+    static constexpr uint32_t none = UINT32_MAX;
+
+    Slab(size_t frame_size, uint32_t frames) : frame_size(frame_size), stride(round_up(frame_size)),
+        data(allocate(stride, frames)), count(data != nullptr ? frames : 0), slots(new Slot[count]) {
+        for (uint32_t i = 0; i < count; ++i)
+            slots[i].next.store(i + 1 < count ? i + 1 : none, std::memory_order_relaxed);
+        head.store(count > 0 ? 0 : none, std::memory_order_relaxed);
+    }
+
+    ~Slab() {
+        free(data);
+    }
+
+    static size_t round_up(size_t frame_size) {
+        if (frame_size > SIZE_MAX - cache_line_size)
+            return SIZE_MAX;
+        return (frame_size + cache_line_size - 1) / cache_line_size * cache_line_size;
+    }
+
+    //! null if the size overflows or the allocation failed, the slab then holds no frames
+    static uint8_t *allocate(size_t stride, uint32_t frames) {
+        if (frames > 0 && stride > SIZE_MAX / frames)
+            return nullptr;
+        return static_cast<uint8_t *>(aligned_alloc(cache_line_size, std::max<size_t>(stride * frames, cache_line_size)));
+    }
+
+    /**
+   * @brief Link indices into a chain and push it onto the free list
+   */
+    void push(const uint32_t *indices, uint32_t n) {
+        for (uint32_t i = 0; i + 1 < n; ++i)
+            slots[indices[i]].next.store(indices[i + 1], std::memory_order_relaxed);
+        uint64_t old_head = head.load(std::memory_order_relaxed);
+        uint64_t new_head;
+        do {
+            slots[indices[n - 1]].next.store((uint32_t)old_head, std::memory_order_relaxed);
+            new_head = ((old_head >> 32) + 1) << 32 | indices[0];
+        } while (!head.compare_exchange_weak(old_head, new_head, std::memory_order_release,
+                                             std::memory_order_relaxed));
+    }
+
+    /**
+   * @brief Pop up to n indices from the free list
+   * @return Number of indices popped
+   * @note The tag in the upper half of head changes on every update, so a successful CAS
+   * proves that the chain walked here was not modified meanwhile.
+   */
+    uint32_t pop(uint32_t *indices, uint32_t n) {
+        uint64_t old_head = head.load(std::memory_order_acquire);
+        uint32_t taken;
+        uint64_t new_head;
+        do {
+            taken = 0;
+            uint32_t index = (uint32_t)old_head;
+            while (taken < n && index != none) {
+                indices[taken++] = index;
+                index = slots[index].next.load(std::memory_order_relaxed);
+            }
+            if (taken == 0)
+                return 0;
+            new_head = ((old_head >> 32) + 1) << 32 | index;
+        } while (!head.compare_exchange_weak(old_head, new_head, std::memory_order_acquire,
+                                             std::memory_order_acquire));
+        return taken;
+    }
+
+    const size_t frame_size;
+    //! frame_size rounded up to cache lines, so frames on different threads share no line
+    const size_t stride;
+    uint8_t *data;
+    const uint32_t count;
+    //! unique across all slabs, a new slab may reuse the address of a destroyed one
+    const uint64_t id{next_id.fetch_add(1, std::memory_order_relaxed)};
+    std::unique_ptr<Slot[]> slots;
+    //! tag in the upper 32 bits, index of the first free slot in the lower 32 bits
+    alignas(cache_line_size) std::atomic<uint64_t> head{0};
+    std::atomic<size_t> exhausted{0};
+
+    static inline std::atomic<uint64_t> next_id{1};
+};
+
+/**
+ * @brief Fixed size frame buffers carved from one slab, recycled without locks
+ * @note Free buffers are kept in a lock-free list, and each thread caches a few buffers of the
+ * pool it used last, so that steady state acquire and release touch no shared cache line.
+ */
+class FramePool {
+public:
+    /**
+   * @brief Constructor of frame pool, all buffers are allocated once here
+   * @param frame_size capacity of each frame
+   * @param count number of frames
+   * @note If the buffers cannot be allocated the pool is empty, see ok()
+   */
+    FramePool(size_t frame_size, uint32_t count) : slab_(std::make_shared<Slab>(frame_size, count)) {}
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    /**
+   * @brief Take a free buffer, with length 0
+   * @return Empty handle if all buffers are in use
+   */
+    PooledFrame acquire() {
+        Cache& cache = thread_cache();
+        if (cache.id != slab_->id) {
+            cache.flush();
+            cache.owner = slab_;
+            cache.slab = slab_.get();
+            cache.id = slab_->id;
+        }
+        if (cache.count == 0)
+            cache.count = slab_->pop(cache.slots, Cache::batch);
+        if (cache.count == 0) {
+            slab_->exhausted.fetch_add(1, std::memory_order_relaxed);
+            return PooledFrame();
+        }
+        uint32_t index = cache.slots[--cache.count];
+        PooledFrame::Slot& slot = slab_->slots[index];
+        slot.refs.store(1, std::memory_order_relaxed);
+        slot.length = 0;
+        return PooledFrame(slab_.get(), index);
+    }
+
+    /**
+   * @brief Copy a frame into a pooled buffer
+   * @param frame Frame bytes
+   * @return Empty handle if the frame is too long or all buffers are in use
+   */
+    PooledFrame copy(std::span<const uint8_t> frame) {
+        if (frame.size() > slab_->frame_size) {
+            slab_->exhausted.fetch_add(1, std::memory_order_relaxed);
+            return PooledFrame();
+        }
+        PooledFrame result = acquire();
+        if (result) {
+            memcpy(result.writable().data(), frame.data(), frame.size());
+            result.resize(frame.size());
+        }
+        return result;
+    }
+
+    //! the buffers were allocated, otherwise count() is 0 and acquire() always fails
+    bool ok() const {
+        return slab_->data != nullptr;
+    }
+
+    size_t frame_size() const {
+        return slab_->frame_size;
+    }
+
+    uint32_t count() const {
+        return slab_->count;
+    }
+
+    //! number of acquire() and copy() calls that found no usable buffer
+    size_t exhausted() const {
+        return slab_->exhausted.load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class PooledFrame;
+
+    using Slab = PooledFrame::Slab;
+
+    /**
+   * @brief Per thread free buffers, bound to one pool at a time
+   * @note The cache does not keep its pool's slab alive. Once the pool is destroyed, the cached
+   * buffers are dropped with it, and the id makes sure the cache never takes a later slab at the
+   * same address for the old one.
+   */
+    struct Cache {
+        static constexpr uint32_t capacity = 64;
+        static constexpr uint32_t batch = capacity / 2;
+
+        ~Cache() {
+            flush();
+        }
+
+        //! hand all cached buffers back to the bound pool, if it still exists
+        void flush() {
+            if (count > 0) {
+                if (std::shared_ptr<Slab> alive = owner.lock())
+                    alive->push(slots, count);
+            }
+            count = 0;
+        }
+
+        std::weak_ptr<Slab> owner;
+        //! the bound slab, only dereferenced while a pool or a handle of it is known to be alive
+        Slab *slab{nullptr};
+        //! id of the bound slab, 0 if none
+        uint64_t id{0};
+        uint32_t count{0};
+        uint32_t slots[capacity];
+    };
+
+    static Cache& thread_cache() {
+        static thread_local Cache cache;
+        return cache;
+    }
+
+    static void release(Slab *slab, uint32_t index) {
+        Cache& cache = thread_cache();
+        if (cache.id != slab->id) {
+            slab->push(&index, 1);
+            return;
+        }
+        if (cache.count == Cache::capacity) {
+            /* return the older half to the shared list, one CAS for all */
+            slab->push(cache.slots, Cache::batch);
+            cache.count -= Cache::batch;
+            memmove(cache.slots, cache.slots + Cache::batch, cache.count * sizeof(uint32_t));
+        }
+        cache.slots[cache.count++] = index;
+    }
+
+    std::shared_ptr<Slab> slab_;
+};
+
+inline PooledFrame::Slot& PooledFrame::slot() const {
+    return slab_->slots[index_];
+}
+
+inline void PooledFrame::reset() {
+    if (slab_ == nullptr)
+        return;
+    if (slot().refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        FramePool::release(slab_, index_);
+    slab_ = nullptr;
+}
+
+inline const uint8_t *PooledFrame::data() const {
+    return slab_ != nullptr ? slab_->data + index_ * slab_->stride : nullptr;
+}
+
+inline size_t PooledFrame::capacity() const {
+    return slab_ != nullptr ? slab_->frame_size : 0;
+}
+
+inline std::span<uint8_t> PooledFrame::writable() {
+    if (slab_ == nullptr)
+        return {};
+    return std::span<uint8_t>(slab_->data + index_ * slab_->stride, slab_->frame_size);
+}
+
+/**
+ * @brief Frames terminated by a single delimiter byte, the delimiter is not part of the frame
+ * @tparam Delimiter frame delimiter, i.e. '\n' for NMEA
+ */
+template <uint8_t Delimiter = '\n'>
+struct DelimiterDecoder {
+    static constexpr uint8_t delimiter = Delimiter;
+
+    /**
+   * @brief Find the end of the first frame
+   * @param data Buffered bytes
+   * @param len Buffered length
+   * @param from Bytes already known to hold no frame end
+   * @return Length of the frame including its delimiter, 0 if incomplete
+   */
+    size_t find_end(const uint8_t *data, size_t len, size_t from) const {
+        size_t end = from + simd::find_byte(data + from, len - from, Delimiter);
+        return end < len ? end + 1 : 0;
+    }
+
+    /**
+   * @brief Decode a complete frame in place
+   * @param data Frame returned by find_end
+   * @param len Frame length including its delimiter
+   * @param frame Updated with the decoded frame
+   * @return True if the frame is well formed
+   */
+    bool decode(uint8_t *data, size_t len, std::span<const uint8_t>& frame) const {
+        frame = std::span<const uint8_t>(data, len - 1);
+        return true;
+    }
+};
+
+/**
+ * @brief Consistent overhead byte stuffing, frames are terminated by 0x00
+ */
+struct CobsDecoder {
+    static constexpr uint8_t delimiter = 0x00;
+
+    size_t find_end(const uint8_t *data, size_t len, size_t from) const {
+        size_t end = from + simd::find_byte(data + from, len - from, delimiter);
+        return end < len ? end + 1 : 0;
+    }
+
+    bool decode(uint8_t *data, size_t len, std::span<const uint8_t>& frame) const {
+        size_t r = 0, w = 0;
+        --len;
+        while (r < len) {
+            size_t code = data[r++];
+            if (code == 0 || r + code - 1 > len)
+                return false;
+            memmove(data + w, data + r, code - 1);
+            w += code - 1;
+            r += code - 1;
+            if (code != 0xFF && r < len)
+                data[w++] = 0;
+        }
+        frame = std::span<const uint8_t>(data, w);
+        return true;
+    }
+};
+
+/**
+ * @brief Serial line internet protocol (RFC 1055), frames are terminated by 0xC0
+ */
+struct SlipDecoder {
+    static constexpr uint8_t delimiter = simd::slip_end;
+
+    size_t find_end(const uint8_t *data, size_t len, size_t from) const {
+        size_t end = from + simd::find_byte(data + from, len - from, delimiter);
+        return end < len ? end + 1 : 0;
+    }
+
+    bool decode(uint8_t *data, size_t len, std::span<const uint8_t>& frame) const {
+        --len;
+        if (!simd::slip_unescape(data, len))
+            return false;
+        frame = std::span<const uint8_t>(data, len);
+        return true;
+    }
+};
+
+/**
+ * @brief Frames preceded by their payload length
+ * @tparam LengthBytes size of the length field, 1 to 4
+ * @tparam BigEndian byte order of the length field
+ */
+template <size_t LengthBytes = 2, bool BigEndian = true>
+struct LengthPrefixDecoder {
+    static_assert(LengthBytes >= 1 && LengthBytes <= 4, "length field must be 1 to 4 bytes");
+
+    size_t find_end(const uint8_t *data, size_t len, size_t) const {
+        if (len < LengthBytes)
+            return 0;
+        size_t payload = 0;
+        for (size_t i = 0; i < LengthBytes; ++i)
+            payload |= (size_t)data[BigEndian ? i : LengthBytes - 1 - i] << (8 * (LengthBytes - 1 - i));
+        return len >= LengthBytes + payload ? LengthBytes + payload : 0;
+    }
+
+    bool decode(uint8_t *data, size_t len, std::span<const uint8_t>& frame) const {
+        frame = std::span<const uint8_t>(data + LengthBytes, len - LengthBytes);
+        return true;
+    }
+};
+
+/**
+ * @brief Frame parser on top of a serial device, frames are decoded in place in one receive buffer
+ * @tparam Decoder frame decoder policy, i.e. CobsDecoder
+ */
+template <typename Decoder>
+class FrameReader {
+public:
+    /**
+   * @brief Constructor of frame reader, the receive buffer is allocated once here
+   * @param transport Initialized serial device or another transport
+   * @param capacity receive buffer size, bounds the frame length
+   * @param decoder frame decoder
+   */
+    explicit FrameReader(Transport& transport, size_t capacity = 4096, Decoder decoder = Decoder())
+        : transport_(transport), decoder_(decoder), buffer_(new uint8_t[capacity]), capacity_(capacity) {}
+
+    /**
+   * @brief Read once from the device into the receive buffer
+   * @return Result of Transport::read
+   * @note Frames returned by next() are invalidated
+   */
+    long long fill() {
+        std::span<uint8_t> region = prepare();
+        long long r = transport_.read(region.data(), region.size());
+        if (r > 0)
+            commit(r);
+        return r;
+    }
+
+    /**
+   * @brief Get the free part of the receive buffer, to be filled from another source
+   * @return Writable region
+   * @note Frames returned by next() are invalidated
+   */
+    std::span<uint8_t> prepare() {
+        if (begin_ > 0) {
+            memmove(buffer_.get(), buffer_.get() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (end_ == capacity_) {
+            /* no frame end in a full buffer, drop it to resynchronize */
+            end_ = 0;
+            scanned_ = 0;
+            ++overflows_;
+        }
+        return std::span<uint8_t>(buffer_.get() + end_, capacity_ - end_);
+    }
+
+    /**
+   * @brief Append bytes written into the region returned by prepare()
+   * @param len Number of bytes written
+   */
+    void commit(size_t len) {
+        end_ += len;
+    }
+
+    /**
+   * @brief Extract the next complete frame from the receive buffer
+   * @param frame Updated with the frame, valid until the next fill() or prepare()
+   * @return True if a frame is available
+   */
+    bool next(std::span<const uint8_t>& frame) {
+        while (begin_ < end_) {
+            uint8_t *data = buffer_.get() + begin_;
+            size_t len = decoder_.find_end(data, end_ - begin_, scanned_);
+            if (len == 0) {
+                scanned_ = end_ - begin_;
+                return false;
+            }
+            begin_ += len;
+            scanned_ = 0;
+            if (!decoder_.decode(data, len, frame))
+                ++dropped_;
+            else if (!frame.empty())
+                return true;
+        }
+        return false;
+    }
+
+    /**
+   * @brief Read once from the device and dispatch all complete frames
+   * @param handler Called with each std::span<const uint8_t> frame
+   * @return Result of Transport::read
+   */
+    template <typename Handler>
+    long long poll(Handler&& handler) {
+        long long r = fill();
+        std::span<const uint8_t> frame;
+        while (next(frame))
+            handler(frame);
+        return r;
+    }
+
+    /**
+   * @brief Extract the next complete frame into a pooled buffer, which may be kept or passed to other threads
+   * @param pool Pool to take the buffer from
+   * @param frame Updated with the frame
+   * @return True if a frame is available, frames not fitting the pool are counted as dropped
+   */
+    bool next(FramePool& pool, PooledFrame& frame) {
+        std::span<const uint8_t> view;
+        while (next(view)) {
+            frame = pool.copy(view);
+            if (frame)
+                return true;
+            ++dropped_;
+        }
+        return false;
+    }
+
+    /**
+   * @brief Read once from the device and dispatch all complete frames in pooled buffers
+   * @param pool Pool to take the buffers from
+   * @param handler Called with each PooledFrame&&
+   * @return Result of Transport::read
+   */
+    template <typename Handler>
+    long long poll(FramePool& pool, Handler&& handler) {
+        long long r = fill();
+        PooledFrame frame;
+        while (next(pool, frame))
+            handler(std::move(frame));
+        return r;
+    }
+
+    /**
+   * @brief Awaitable next() on an event loop, refilling from the device as needed
+   */
+    struct FrameAwaiter : EventLoop::Operation {
+        FrameAwaiter(FrameReader& reader, EventLoop& loop)
+            : EventLoop::Operation{retry, {}}, reader(reader), loop(loop) {}
+
+        static bool retry(EventLoop::Operation *op) {
+            return static_cast<FrameAwaiter *>(op)->attempt();
+        }
+
+        bool attempt() {
+            while (!reader.next(frame)) {
+                long long r = reader.fill();
+                if (r > 0 || (r < 0 && errno == EINTR))
+                    continue;
+                if (r < 0 && errno == EAGAIN)
+                    return false;
+                frame = {};
+                return true;
+            }
+            return true;
+        }
+
+        bool await_ready() {
+            return attempt();
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) {
+            handle = h;
+            return loop.watch(reader.transport_.native_handle(), false, this);
+        }
+
+        std::span<const uint8_t> await_resume() const {
+            return frame;
+        }
+
+        FrameReader& reader;
+        EventLoop& loop;
+        std::span<const uint8_t> frame;
+    };
+
+    /**
+   * @brief Read the next frame on an event loop
+   * @param loop Event loop running on this thread
+   * @return Awaitable giving the frame, empty if the device failed
+   */
+    FrameAwaiter async_read_frame(EventLoop& loop) {
+        return FrameAwaiter(*this, loop);
+    }
+
+    /**
+   * @brief Discard all buffered bytes
+   */
+    void reset() {
+        begin_ = end_ = scanned_ = 0;
+    }
+
+    //! number of malformed frames
+    size_t dropped() const {
+        return dropped_;
+    }
+
+    //! number of times the buffer was dropped because no frame fit
+    size_t overflows() const {
+        return overflows_;
+    }
+
+private:
+    //! serial device or transport to read from
+    Transport& transport_;
+    //! frame decoder policy
+    Decoder decoder_;
+    //! receive buffer, bytes in [begin_, end_) are not parsed yet
+    std::unique_ptr<uint8_t[]> buffer_;
+    size_t capacity_;
+    size_t begin_{0};
+    size_t end_{0};
+    //! bytes after begin_ known to hold no frame end
+    size_t scanned_{0};
+    size_t dropped_{0};
+    size_t overflows_{0};
+};
+
+/**
+ * @brief Pipelined request/response exchanges over a Transport, with replies matched by sequence ID
+ * @tparam Decoder frame decoder of the replies
+ * @tparam Matcher callable bool(std::span<const uint8_t> frame, uint32_t& id), extracts the ID a reply answers
+ * @note Up to max_outstanding requests are in flight at once. Replies may arrive in any order,
+ * and each request completes exactly once, with its reply, on its deadline, or when cancelled.
+ */
+template <typename Decoder, typename Matcher>
+class TransactionEngine {
+public:
+    enum class Status {
+        //! the reply is passed to the callback
+        ok,
+        //! no reply before the deadline
+        timeout,
+        //! cancelled, or the transport failed
+        failed
+    };
+
+    //! called with the reply frame, which is only valid during the call
+    using Callback = std::function<void(Status, std::span<const uint8_t>)>;
+
+    /**
+   * @brief Constructor of transaction engine, the pending table is allocated once here
+   * @param transport Initialized serial device or another transport
+   * @param max_outstanding number of requests in flight
+   * @param matcher reply ID extractor
+   * @param capacity receive buffer size, bounds the reply length
+   * @param decoder frame decoder
+   */
+    TransactionEngine(Transport& transport, size_t max_outstanding, Matcher matcher = Matcher(),
+                      size_t capacity = 4096, Decoder decoder = Decoder())
+        : transport_(transport), reader_(transport, capacity, decoder), matcher_(matcher),
+          pending_(max_outstanding) {}
+
+    TransactionEngine(const TransactionEngine&) = delete;
+    TransactionEngine& operator=(const TransactionEngine&) = delete;
+
+    ~TransactionEngine() {
+        cancel_all();
+    }
+
+    /**
+   * @brief Send a request without waiting for the replies of earlier ones
+   * @param id Sequence ID that the reply will carry
+   * @param request Encoded request frame
+   * @param len Request length
+   * @param deadline Time by which the reply must have arrived
+   * @param callback Called once when the request completes
+   * @return False if the table is full, the ID is already pending, or the request could not be sent
+   * @note A request whose first byte went out is finished even past the deadline, so the peer
+   * never sees a truncated frame; late_sends() counts those
+   */
+    bool submit(uint32_t id, const uint8_t *request, size_t len,
+                std::chrono::steady_clock::time_point deadline, Callback callback) {
+        if (find(id) != nullptr)
+            return false;
+        Pending *slot = nullptr;
+        for (Pending& pending : pending_) {
+            if (!pending.active) {
+                slot = &pending;
+                break;
+            }
+        }
+        if (slot == nullptr || !send(request, len, deadline))
+            return false;
+        slot->active = true;
+        slot->id = id;
+        slot->deadline = deadline;
+        slot->callback = std::move(callback);
+        ++outstanding_;
+        return true;
+    }
+
+    /**
+   * @brief Wait for replies, then complete matched and expired requests
+   * @param nanosecond Timeout in nanosecond, shortened to the earliest deadline
+   * @return Number of completed requests
+   */
+    size_t poll(long long nanosecond) {
+        size_t completed = expire();
+        if (outstanding_ > 0) {
+            long long until = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                earliest_deadline() - std::chrono::steady_clock::now()).count();
+            nanosecond = std::min(nanosecond, std::max(until, 0LL));
+        }
+        if (transport_.wait_readable(std::max(nanosecond, 0LL)) >= 0) {
+            long long r = reader_.fill();
+            /* the callbacks below may write and change errno */
+            int error = r < 0 ? errno : 0;
+            std::span<const uint8_t> frame;
+            while (reader_.next(frame))
+                completed += dispatch(frame);
+            if (error != 0 && error != EAGAIN && error != EINTR && error != EWOULDBLOCK)
+                return completed + cancel_all();
+        }
+        return completed + expire();
+    }
+
+    /**
+   * @brief Complete all pending requests with Status::failed
+   * @return Number of cancelled requests
+   */
+    size_t cancel_all() {
+        size_t cancelled = 0;
+        for (Pending& pending : pending_) {
+            if (pending.active) {
+                complete(pending, Status::failed, {});
+                ++cancelled;
+            }
+        }
+        return cancelled;
+    }
+
+    //! number of requests in flight
+    size_t pending() const {
+        return outstanding_;
+    }
+
+    bool full() const {
+        return outstanding_ == pending_.size();
+    }
+
+    //! number of replies that matched no pending request, i.e. late replies of expired ones
+    size_t unmatched() const {
+        return unmatched_;
+    }
+
+    //! number of requests finished after their deadline because they were partly sent
+    size_t late_sends() const {
+        return late_sends_;
+    }
+
+    FrameReader<Decoder>& reader() {
+        return reader_;
+    }
+
+private:
+    struct Pending {
+        bool active{false};
+        uint32_t id{0};
+        std::chrono::steady_clock::time_point deadline;
+        Callback callback;
+    };
+
+    //! linear search, the table holds as many entries as requests can be in flight
+    Pending *find(uint32_t id) {
+        for (Pending& pending : pending_) {
+            if (pending.active && pending.id == id)
+                return &pending;
+        }
+        return nullptr;
+    }
+
+    std::chrono::steady_clock::time_point earliest_deadline() const {
+        auto earliest = std::chrono::steady_clock::time_point::max();
+        for (const Pending& pending : pending_) {
+            if (pending.active && pending.deadline < earliest)
+                earliest = pending.deadline;
+        }
+        return earliest;
+    }
+
+    //! write the whole request, waiting while the transport is full, until the deadline if nothing went out yet
+    bool send(const uint8_t *request, size_t len, std::chrono::steady_clock::time_point deadline) {
+        size_t done = 0;
+        bool late = false;
+        while (done < len) {
+            long long r = transport_.write(request + done, len - done);
+            if (r > 0) {
+                done += r;
+                continue;
+            }
+            if (r < 0 && errno != EAGAIN && errno != EINTR && errno != EWOULDBLOCK)
+                return false;
+            if (!late && std::chrono::steady_clock::now() >= deadline) {
+                /* a partly sent frame would misframe every later request */
+                if (done == 0)
+                    return false;
+                late = true;
+                ++late_sends_;
+            }
+            pollfd pfd{transport_.native_handle(), POLLOUT, 0};
+            if (pfd.fd < 0 || ::poll(&pfd, 1, 1) == 0)
+                std::this_thread::yield();
+        }
+        return true;
+    }
+
+    size_t dispatch(std::span<const uint8_t> frame) {
+        uint32_t id;
+        Pending *pending = matcher_(frame, id) ? find(id) : nullptr;
+        if (pending == nullptr) {
+            ++unmatched_;
+            return 0;
+        }
+        complete(*pending, Status::ok, frame);
+        return 1;
+    }
+
+    size_t expire() {
+        if (outstanding_ == 0)
+            return 0;
+        size_t expired = 0;
+        auto now = std::chrono::steady_clock::now();
+        for (Pending& pending : pending_) {
+            if (pending.active && pending.deadline <= now) {
+                complete(pending, Status::timeout, {});
+                ++expired;
+            }
+        }
+        return expired;
+    }
+
+    //! free the slot before the call, so that the callback may submit again
+    void complete(Pending& pending, Status status, std::span<const uint8_t> frame) {
+        Callback callback = std::move(pending.callback);
+        pending.callback = nullptr;
+        pending.active = false;
+        --outstanding_;
+        if (callback)
+            callback(status, frame);
+    }
+
+    Transport& transport_;
+    FrameReader<Decoder> reader_;
+    Matcher matcher_;
+    //! preallocated pending table
+    std::vector<Pending> pending_;
+    size_t outstanding_{0};
+    size_t unmatched_{0};
+    size_t late_sends_{0};
+};
+
+/**
+ * @brief Received bytes with the CLOCK_MONOTONIC time they were seen
+ */
+struct TimedChunk {
+    //! nanoseconds on CLOCK_MONOTONIC when the last byte was available
+    uint64_t timestamp;
+    //! nanoseconds on CLOCK_MONOTONIC of the readiness wakeup that read the chunk, not back-dated
+    uint64_t wakeup;
+    std::span<const uint8_t> data;
+    //! nanoseconds one character takes on the line, 0 if unknown
+    uint64_t char_time;
+
+    /**
+   * @brief Estimate the arrival time of a byte from the baudrate, assuming a back to back burst
+   * @param i Index of the byte in data
+   * @return Nanoseconds on CLOCK_MONOTONIC
+   */
+    uint64_t arrival(size_t i) const {
+        return timestamp - (data.size() - 1 - i) * char_time;
+    }
+};
+
+/**
+ * @brief Receive path pairing each chunk read with the time of the readiness wakeup
+ *
+ * The producer calls poll() or fill(), the consumer calls next(); they may run on two threads.
+ * Bytes and records live in preallocated rings, so receiving costs one clock read per wakeup.
+ */
+class TimestampedReader {
+public:
+    /**
+   * @brief Constructor of timestamped reader, the rings are allocated once here
+   * @param serial Initialized serial device with a non-blocking read policy
+   * @param capacity receive ring size in bytes
+   * @param max_chunks maximum number of chunks not consumed yet
+   */
+    explicit TimestampedReader(Serial& serial, size_t capacity = 65536, size_t max_chunks = 1024)
+        : serial_(serial), bytes_(capacity), records_(max_chunks), char_time_(serial.config().char_time()) {}
+
+    /**
+   * @brief Wait for data, take the timestamp right after the wakeup and drain the device
+   * @param nanosecond Timeout in nanosecond, negative to wait forever
+   * @return -1 if failed, else the number of bytes received, 0 on timeout or if the rings are full
+   */
+    long long poll(long long nanosecond) {
+        if (!has_room())
+            return 0;
+        pollfd serial_pollfd{serial_.native_handle(), POLLIN, 0};
+        timespec timeout_ts{(time_t)(nanosecond / 1000000000), (long)(nanosecond % 1000000000)};
+        int r = ppoll(&serial_pollfd, 1, nanosecond < 0 ? nullptr : &timeout_ts, nullptr);
+        if (r <= 0)
+            return r < 0 && errno != EINTR ? -1 : 0;
+        return drain(now());
+    }
+
+    /**
+   * @brief Drain the device without waiting, i.e. after an external epoll wakeup
+   * @return -1 if failed, else the number of bytes received
+   */
+    long long fill() {
+        if (!has_room())
+            return 0;
+        return drain(now());
+    }
+
+    /**
+   * @brief Get the oldest chunk, the previous one returned is released
+   * @param chunk Updated with the chunk, valid until the next call
+   * @return True if a chunk is available
+   */
+    bool next(TimedChunk& chunk) {
+        release();
+        size_t n;
+        const Record *record = records_.read_region(n);
+        if (record == nullptr)
+            return false;
+        const uint8_t *data = bytes_.read_region(n);
+        chunk.timestamp = record->timestamp;
+        chunk.wakeup = record->wakeup;
+        chunk.data = std::span<const uint8_t>(data, record->length);
+        chunk.char_time = char_time_;
+        held_ = record->length;
+        return true;
+    }
+
+    /**
+   * @brief Release the chunk returned by next() before the next call
+   */
+    void release() {
+        if (held_ == 0)
+            return;
+        bytes_.commit_read(held_);
+        records_.commit_read(1);
+        held_ = 0;
+    }
+
+    //! number of times the rings were full, the data waits in the kernel buffer meanwhile
+    size_t stalls() const {
+        return stalls_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Record {
+        uint64_t timestamp;
+        uint64_t wakeup;
+        uint32_t length;
+    };
+
+    static uint64_t now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    bool has_room() {
+        if (records_.size() < records_.capacity() && bytes_.size() < bytes_.capacity())
+            return true;
+        stalls_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    /**
+   * @brief Read until the device would block, one chunk per contiguous free region
+   * @param timestamp time of the wakeup, given to the last byte read
+   * @return -1 if failed, else the number of bytes received
+   */
+    long long drain(uint64_t timestamp) {
+        constexpr size_t max_reads = 8;
+        Record records[max_reads];
+        size_t reads = 0;
+        long long total = 0;
+        int error = 0;
+        while (reads < max_reads && records_.size() + reads < records_.capacity()) {
+            size_t room;
+            uint8_t *region = bytes_.write_region(room);
+            if (region == nullptr) {
+                stalls_.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            long long r = serial_.read(region, std::min<size_t>(room, UINT32_MAX));
+            if (r <= 0) {
+                if (r < 0 && errno != EAGAIN && errno != EINTR)
+                    error = errno;
+                break;
+            }
+            bytes_.commit_write(r);
+            records[reads++].length = (uint32_t)r;
+            total += r;
+            /* a short read means the kernel buffer is drained */
+            if ((size_t)r < room)
+                break;
+        }
+        /* the bytes of one wakeup arrived back to back, so earlier chunks get earlier timestamps */
+        uint64_t later = 0;
+        for (size_t i = reads; i-- > 0;) {
+            records[i].timestamp = timestamp - later * char_time_;
+            records[i].wakeup = timestamp;
+            later += records[i].length;
+        }
+        records_.push(records, reads);
+        if (reads == 0 && error) {
+            errno = error;
+            return -1;
+        }
+        return total;
+    }
+
+    Serial& serial_;
+    SpscRing<uint8_t> bytes_;
+    SpscRing<Record> records_;
+    uint64_t char_time_;
+    //! bytes of the chunk returned by next(), consumer side
+    size_t held_{0};
+    std::atomic<size_t> stalls_{0};
+};
+
+/**
+ * @brief Merges the received data of many ports into one stream ordered by receive wakeup
+ * @note Poller threads drain the ports into per-port TimestampedReader rings, and a single
+ * consumer merges the ring heads. A chunk is only handed out once every port is known to hold
+ * no chunk of an earlier wakeup, so the order holds across ports and threads. The merge uses
+ * TimedChunk::wakeup, the back-dated timestamps of chunks read in one wakeup may overlap
+ * those of another port.
+ */
+class FanInAggregator {
+public:
+    struct Chunk {
+        //! index returned by add()
+        size_t port;
+        TimedChunk chunk;
+    };
+
+    /**
+   * @brief Constructor of fan-in aggregator
+   * @param threads number of poller threads, the ports are distributed over them
+   * @param capacity receive ring size of each port in bytes
+   * @param max_chunks maximum number of chunks of each port not consumed yet
+   */
+    explicit FanInAggregator(size_t threads = 1, size_t capacity = 65536, size_t max_chunks = 1024)
+        : threads_(std::max<size_t>(threads, 1)), capacity_(capacity), max_chunks_(max_chunks) {}
+
+    FanInAggregator(const FanInAggregator&) = delete;
+    FanInAggregator& operator=(const FanInAggregator&) = delete;
+
+    ~FanInAggregator() {
+        stop();
+    }
+
+    /**
+   * @brief Add a port, before start()
+   * @param serial Initialized serial device with a non-blocking read policy
+   * @param priority ports with a higher priority are drained first, and win ties of equal timestamps
+   * @return Port index, -1 if already started
+   */
+    int add(Serial& serial, int priority = 0) {
+        if (running_)
+            return -1;
+        ports_.push_back(std::make_unique<Port>(serial, ports_.size(), priority, capacity_, max_chunks_));
+        return (int)ports_.size() - 1;
+    }
+
+    /**
+   * @brief Start the poller threads
+   * @param cpus CPUs to pin the poller threads to, thread i runs on cpus[i % cpus.size()], empty for no pinning
+   * @param fifo_priority SCHED_FIFO priority of the poller threads, 0 keeps the default policy
+   * @return True if started with all settings applied, errno is set otherwise
+   * @note SCHED_FIFO usually needs CAP_SYS_NICE or an rtprio limit
+   */
+    bool start(std::span<const int> cpus = {}, int fifo_priority = 0) {
+        if (running_ || ports_.empty())
+            return false;
+        running_ = true;
+        size_t threads = std::min(threads_, ports_.size());
+        for (size_t i = 0; i < threads; ++i) {
+            std::vector<Port *> ports;
+            for (size_t j = i; j < ports_.size(); j += threads)
+                ports.push_back(ports_[j].get());
+            /* drain higher priority ports first within every wakeup */
+            std::stable_sort(ports.begin(), ports.end(),
+                             [](const Port *a, const Port *b) { return a->priority > b->priority; });
+            pollers_.emplace_back(&FanInAggregator::run, this, std::move(ports));
+        }
+        for (size_t i = 0; i < pollers_.size(); ++i) {
+            int error = 0;
+            if (!cpus.empty()) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpus[i % cpus.size()], &set);
+                error = pthread_setaffinity_np(pollers_[i].native_handle(), sizeof(set), &set);
+            }
+            if (error == 0 && fifo_priority > 0) {
+                sched_param param{};
+                param.sched_priority = fifo_priority;
+                error = pthread_setschedparam(pollers_[i].native_handle(), SCHED_FIFO, &param);
+            }
+            if (error != 0) {
+                stop();
+                errno = error;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+   * @brief Stop and join the poller threads, chunks not consumed yet are kept
+   */
+    void stop() {
+        running_ = false;
+        for (auto& poller : pollers_)
+            poller.join();
+        pollers_.clear();
+    }
+
+    /**
+   * @brief Get the chunk with the earliest wakeup of all ports, consumer side
+   * @param chunk Updated with the chunk, valid until the next call
+   * @return True if a chunk is available, false if some port may still deliver earlier data,
+   * or with errno set once a poller thread failed
+   * @note Scans the heads of all ports, which is cheaper than a heap for tens of ports.
+   */
+    bool next(Chunk& chunk) {
+        if (emitted_ != nullptr) {
+            emitted_->reader.release();
+            emitted_->has_head = false;
+            emitted_ = nullptr;
+        }
+        if (int error = error_.load(std::memory_order_acquire)) {
+            errno = error;
+            return false;
+        }
+        Port *best = nullptr;
+        for (auto& port : ports_) {
+            if (!port->has_head)
+                port->has_head = port->reader.next(port->head);
+            if (port->has_head && (best == nullptr || port->head.wakeup < best->head.wakeup ||
+                                   (port->head.wakeup == best->head.wakeup && port->priority > best->priority)))
+                best = port.get();
+        }
+        if (best == nullptr)
+            return false;
+        for (auto& port : ports_) {
+            if (port->has_head)
+                continue;
+            /* an empty port may still get data of a wakeup before the best head */
+            uint64_t watermark = port->watermark.load(std::memory_order_acquire);
+            if (watermark < best->head.wakeup)
+                return false;
+            /* a closed port pushed its last chunks before the watermark, they may be earlier */
+            if (watermark == closed_watermark && (port->has_head = port->reader.next(port->head)))
+                return false;
+        }
+        chunk.port = best->index;
+        chunk.chunk = best->head;
+        emitted_ = best;
+        return true;
+    }
+
+    size_t ports() const {
+        return ports_.size();
+    }
+
+    /**
+   * @brief Check if a port hung up or failed, its poller stopped watching it
+   * @param port Index returned by add()
+   */
+    bool closed(size_t port) const {
+        return ports_[port]->watermark.load(std::memory_order_acquire) == closed_watermark;
+    }
+
+    //! a poller thread stopped on an epoll error, next() fails from then on
+    bool failed() const {
+        return error_.load(std::memory_order_acquire) != 0;
+    }
+
+    //! number of times a port's rings were full, summed over all ports
+    size_t stalls() const {
+        size_t stalls = 0;
+        for (const auto& port : ports_)
+            stalls += port->reader.stalls();
+        return stalls;
+    }
+
+private:
+    struct Port {
+        Port(Serial& serial, size_t index, int priority, size_t capacity, size_t max_chunks)
+            : reader(serial, capacity, max_chunks), fd(serial.native_handle()), index(index), priority(priority) {}
+
+        TimestampedReader reader;
+        int fd;
+        size_t index;
+        int priority;
+        //! CLOCK_MONOTONIC time before which all wakeups of the port are in the rings, poller side
+        alignas(cache_line_size) std::atomic<uint64_t> watermark{0};
+        //! head chunk taken from the rings, consumer side
+        alignas(cache_line_size) TimedChunk head{};
+        bool has_head{false};
+    };
+
+    //! longest time a watermark lags behind on an idle port
+    static constexpr int watermark_interval_ms = 1;
+    //! watermark of a port that will not deliver any more data
+    static constexpr uint64_t closed_watermark = UINT64_MAX;
+
+    static uint64_t now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    //! keep the first error of any poller thread
+    void fail(int error) {
+        int expected = 0;
+        error_.compare_exchange_strong(expected, error ? error : EIO, std::memory_order_release);
+    }
+
+    void run(std::vector<Port *> ports) {
+        int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            fail(errno);
+            return;
+        }
+        for (size_t i = 0; i < ports.size(); ++i) {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = i;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ports[i]->fd, &ev) != 0) {
+                fail(errno);
+                close(epoll_fd);
+                return;
+            }
+        }
+        std::vector<epoll_event> events(ports.size());
+        std::vector<uint32_t> ready(ports.size());
+        while (running_) {
+            /* data that arrives from here on is seen by this epoll_wait or a later one */
+            uint64_t pass = now();
+            int n = epoll_wait(epoll_fd, events.data(), (int)events.size(), watermark_interval_ms);
+            if (n < 0 && errno != EINTR) {
+                fail(errno);
+                break;
+            }
+            std::fill(ready.begin(), ready.end(), 0);
+            for (int i = 0; i < n; ++i)
+                ready[events[i].data.u64] = events[i].events;
+            bool stalled = false;
+            for (size_t i = 0; i < ports.size(); ++i) {
+                Port *port = ports[i];
+                if (port->watermark.load(std::memory_order_relaxed) == closed_watermark)
+                    continue;
+                if (ready[i]) {
+                    size_t stalls = port->reader.stalls();
+                    long long r;
+                    while ((r = port->reader.fill()) > 0) {
+                    }
+                    /* the port is drained unless its rings filled up */
+                    if (port->reader.stalls() != stalls) {
+                        stalled = true;
+                        continue;
+                    }
+                    /* a hung up port stays ready and would wake up every epoll_wait */
+                    if (r < 0 || (ready[i] & (EPOLLHUP | EPOLLERR))) {
+                        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, port->fd, nullptr);
+                        port->watermark.store(closed_watermark, std::memory_order_release);
+                        continue;
+                    }
+                }
+                port->watermark.store(pass, std::memory_order_release);
+            }
+            if (stalled)
+                std::this_thread::yield();
+        }
+        close(epoll_fd);
+    }
+
+    size_t threads_;
+    size_t capacity_;
+    size_t max_chunks_;
+    std::vector<std::unique_ptr<Port>> ports_;
+    std::vector<std::thread> pollers_;
+    std::atomic<bool> running_{false};
+    //! first error of a poller thread, 0 while all run
+    std::atomic<int> error_{0};
+    //! port whose head was returned by the last next()
+    Port *emitted_{nullptr};
+};
+
+/**
+ * @brief Serves a capture log through the read API of Serial, the log is memory mapped
+ */
+class ReplaySerial final : public Transport {
+public:
+    enum class Pace {
+        //! bytes become readable as fast as they are read
+        fast,
+        //! bytes become readable at the time offsets they were captured with
+        recorded
+    };
+
+    /**
+   * @brief Constructor of replay, the log is mapped once here
+   * @param path capture log written by CaptureWriter
+   * @param pace replay speed
+   */
+    explicit ReplaySerial(const std::string& path, Pace pace = Pace::fast) : pace_(pace) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(capture::FileHeader)) {
+            void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                data_ = static_cast<const uint8_t *>(map);
+                size_ = st.st_size;
+                madvise(map, size_, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+        if (data_ && memcmp(data_, capture::magic, sizeof(capture::magic)) != 0) {
+            munmap(const_cast<uint8_t *>(data_), size_);
+            data_ = nullptr;
+        }
+        rewind();
+    }
+
+    ~ReplaySerial() {
+        if (data_)
+            munmap(const_cast<uint8_t *>(data_), size_);
+    }
+
+    ReplaySerial(const ReplaySerial&) = delete;
+    ReplaySerial& operator=(const ReplaySerial&) = delete;
+
+    //! the log was mapped and has a valid header
+    bool ok() const {
+        return data_ != nullptr;
+    }
+
+    /**
+   * @brief Restart from the first record, the recorded pace restarts from now
+   */
+    void rewind() {
+        offset_ = sizeof(capture::FileHeader);
+        consumed_ = 0;
+        start_ = capture::now();
+        base_ = 0;
+        capture::RecordHeader header;
+        if (peek(sizeof(capture::FileHeader), header))
+            base_ = header.timestamp;
+        skip_tx();
+    }
+
+    /**
+   * @brief Get the next received bytes without copying
+   * @param len Maximum number of bytes
+   * @return Bytes of the current record inside the mapping, empty if none are due yet or the log ended
+   */
+    std::span<const uint8_t> read_view(size_t len) {
+        capture::RecordHeader header;
+        if (!peek(offset_, header) || due_in(header) > 0)
+            return {};
+        size_t n = std::min<size_t>(len, header.length - consumed_);
+        std::span<const uint8_t> view(data_ + offset_ + sizeof(header) + consumed_, n);
+        consumed_ += n;
+        if (consumed_ == header.length) {
+            offset_ += sizeof(header) + header.length;
+            consumed_ = 0;
+            skip_tx();
+        }
+        return view;
+    }
+
+    /**
+   * @brief Serial::read compatible copy of read_view
+   * @return 0 at the end of the log, -1 with EAGAIN if the next bytes are not due yet, else the read length
+   */
+    long long read(uint8_t *buf, size_t len) override {
+        if (nullptr == buf)
+            return -1;
+        if (eof())
+            return 0;
+        size_t total = 0;
+        while (total < len) {
+            std::span<const uint8_t> view = read_view(len - total);
+            if (view.empty())
+                break;
+            memcpy(buf + total, view.data(), view.size());
+            total += view.size();
+        }
+        if (total == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        return total;
+    }
+
+    /**
+   * @brief Accept written bytes, the log already contains the responses
+   * @return The send length
+   */
+    long long write(const uint8_t *buf, size_t len) override {
+        return nullptr == buf ? -1 : (long long)len;
+    }
+
+    /**
+   * @brief Wait until the next received bytes are due
+   * @param nanosecond Timeout in nanosecond
+   * @return -1 if timeout or at the end of the log, else the bytes due in the current record
+   * @note Like a device, a timeout only returns once the timeout passed
+   */
+    long long wait_readable(long long nanosecond) override {
+        capture::RecordHeader header;
+        if (!peek(offset_, header))
+            return -1;
+        long long wait = due_in(header);
+        if (wait > nanosecond) {
+            if (nanosecond > 0)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(nanosecond));
+            return -1;
+        }
+        if (wait > 0)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+        return header.length - consumed_;
+    }
+
+    /**
+   * @brief Iterate over all records of the log, independent of read()
+   * @param offset Position in the log, start with 0
+   * @param header Updated with the record header
+   * @param payload Updated with the record payload
+   * @return False at the end of the log
+   */
+    bool record_at(size_t& offset, capture::RecordHeader& header, std::span<const uint8_t>& payload) const {
+        if (offset == 0)
+            offset = sizeof(capture::FileHeader);
+        if (!peek(offset, header))
+            return false;
+        payload = std::span<const uint8_t>(data_ + offset + sizeof(header), header.length);
+        offset += sizeof(header) + header.length;
+        return true;
+    }
+
+    //! a replay has no file descriptor
+    int native_handle() const override {
+        return -1;
+    }
+
+    //! all received bytes were read
+    bool eof() const {
+        capture::RecordHeader header;
+        return !peek(offset_, header);
+    }
+
+private:
+    //! copy a record header, false past the last complete record
+    bool peek(size_t offset, capture::RecordHeader& header) const {
+        if (!data_ || offset + sizeof(header) > size_)
+            return false;
+        memcpy(&header, data_ + offset, sizeof(header));
+        return offset + sizeof(header) + header.length <= size_;
+    }
+
+    //! advance past transmitted records, they are not read back
+    void skip_tx() {
+        capture::RecordHeader header;
+        while (peek(offset_, header) && header.direction != capture::rx)
+            offset_ += sizeof(header) + header.length;
+    }
+
+    //! nanoseconds until a record is due, 0 or less if due
+    long long due_in(const capture::RecordHeader& header) const {
+        if (pace_ == Pace::fast)
+            return 0;
+        return (long long)(header.timestamp - base_) - (long long)(capture::now() - start_);
+    }
+
+    const uint8_t *data_{nullptr};
+    size_t size_{0};
+    Pace pace_;
+    //! header of the current received record
+    size_t offset_{0};
+    //! bytes of the current record already read
+    size_t consumed_{0};
+    //! replay start and the timestamp of the first record, for the recorded pace
+    uint64_t start_{0};
+    uint64_t base_{0};
+};
+
+namespace simd {
+inline uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len);
+inline uint32_t crc32c_update(uint32_t crc, const uint8_t *data, size_t len);
+}
+
+/**
+ * @brief Incremental CRC with slice-by-8 tables built at compile time
+ * @tparam T register type, its width is the CRC width
+ * @tparam Poly generator polynomial, bit reversed if Reflected
+ * @tparam Init initial register value
+ * @tparam Reflected true if input and output are bit reflected
+ * @tparam XorOut value xored into the register to get the CRC
+ * @note CRC-32 and CRC-32C use the CPU crc32/pclmul instructions when available
+ */
+template <typename T, T Poly, T Init, bool Reflected, T XorOut>
+class Crc {
+public:
+    using value_type = T;
+    static constexpr size_t width = sizeof(T) * 8;
+
+    /**
+   * @brief Feed data, can be called for each partial read of a frame
+   * @param data Data to be checksummed
+   * @param len Data length
+   * @return Reference to this
+   */
+    Crc& update(const uint8_t *data, size_t len) {
+        state_ = update(state_, data, len);
+        return *this;
+    }
+
+    Crc& update(std::span<const uint8_t> data) {
+        return update(data.data(), data.size());
+    }
+
+    T value() const {
+        return state_ ^ XorOut;
+    }
+
+    void reset() {
+        state_ = Init;
+    }
+
+    /**
+   * @brief Compute the CRC of a complete buffer
+   */
+    static T compute(const uint8_t *data, size_t len) {
+        return update(Init, data, len) ^ XorOut;
+    }
+
+    static T compute(std::span<const uint8_t> data) {
+        return compute(data.data(), data.size());
+    }
+
+    /**
+   * @brief Advance a raw CRC register, dispatched to the fastest available kernel
+   */
+    static T update(T state, const uint8_t *data, size_t len) {
+        if constexpr (width == 32 && Reflected && Poly == 0xEDB88320u)
+            return simd::crc32_update(state, data, len);
+        else if constexpr (width == 32 && Reflected && Poly == 0x82F63B78u)
+            return simd::crc32c_update(state, data, len);
+        else
+            return update_table(state, data, len);
+    }
+
+    /**
+   * @brief Advance a raw CRC register with the slice-by-8 tables
+   */
+    static T update_table(T state, const uint8_t *data, size_t len) {
+        uint64_t crc = state;
+        for (; len >= 8; data += 8, len -= 8) {
+            uint64_t word = 0;
+            for (size_t k = 0; k < 8; ++k)
+                word |= (uint64_t)data[k] << (Reflected ? 8 * k : 56 - 8 * k);
+            word ^= Reflected ? crc : crc << (64 - width);
+            crc = 0;
+            for (size_t k = 0; k < 8; ++k)
+                crc ^= tables[7 - k][(word >> (Reflected ? 8 * k : 56 - 8 * k)) & 0xFF];
+        }
+        for (; len > 0; ++data, --len) {
+            if constexpr (Reflected)
+                crc = (crc >> 8) ^ tables[0][(crc ^ *data) & 0xFF];
+            else
+                crc = ((crc << 8) & mask) ^ tables[0][((crc >> (width - 8)) ^ *data) & 0xFF];
+        }
+        return (T)crc;
+    }
+
+private:
+    static constexpr uint64_t mask = width == 64 ? ~0ull : (1ull << width) - 1;
+
+    static constexpr std::array<std::array<T, 256>, 8> make_tables() {
+        std::array<std::array<T, 256>, 8> t{};
+        for (uint64_t i = 0; i < 256; ++i) {
+            uint64_t crc = Reflected ? i : i << (width - 8);
+            for (int bit = 0; bit < 8; ++bit) {
+                if constexpr (Reflected)
+                    crc = crc & 1 ? (crc >> 1) ^ Poly : crc >> 1;
+                else
+                    crc = (crc >> (width - 1)) & 1 ? ((crc << 1) ^ Poly) & mask : (crc << 1) & mask;
+            }
+            t[0][i] = (T)crc;
+        }
+        for (size_t k = 1; k < 8; ++k) {
+            for (size_t i = 0; i < 256; ++i) {
+                uint64_t prev = t[k - 1][i];
+                if constexpr (Reflected)
+                    t[k][i] = (T)((prev >> 8) ^ t[0][prev & 0xFF]);
+                else
+                    t[k][i] = (T)(((prev << 8) & mask) ^ t[0][(prev >> (width - 8)) & 0xFF]);
+            }
+        }
+        return t;
+    }
+
+    static constexpr std::array<std::array<T, 256>, 8> tables = make_tables();
+
+    //! raw CRC register
+    T state_{Init};
+};
+
+//! CRC-16/CCITT-FALSE, poly 0x1021, init 0xFFFF
+using Crc16Ccitt = Crc<uint16_t, 0x1021, 0xFFFF, false, 0x0000>;
+//! CRC-16/XMODEM, poly 0x1021, init 0x0000
+using Crc16Xmodem = Crc<uint16_t, 0x1021, 0x0000, false, 0x0000>;
+//! CRC-16/KERMIT, reflected poly 0x1021, init 0x0000
+using Crc16Kermit = Crc<uint16_t, 0x8408, 0x0000, true, 0x0000>;
+//! CRC-16/MODBUS, reflected poly 0x8005, init 0xFFFF
+using Crc16Modbus = Crc<uint16_t, 0xA001, 0xFFFF, true, 0x0000>;
+//! CRC-32 (IEEE 802.3), reflected poly 0x04C11DB7
+using Crc32 = Crc<uint32_t, 0xEDB88320u, 0xFFFFFFFFu, true, 0xFFFFFFFFu>;
+//! CRC-32C (Castagnoli), reflected poly 0x1EDC6F41
+using Crc32c = Crc<uint32_t, 0x82F63B78u, 0xFFFFFFFFu, true, 0xFFFFFFFFu>;
+
+namespace simd {
+
+#if defined(__x86_64__) || defined(__i386__)
+namespace sse42 {
+
+__attribute__((target("sse4.2")))
+inline uint32_t crc32c_update(uint32_t crc, const uint8_t *data, size_t len) {
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; len >= 8; data += 8, len -= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+#endif
+    for (; len > 0; ++data, --len)
+        crc = _mm_crc32_u8(crc, *data);
+    return crc;
+}
+
+}
+
+namespace pclmul {
+
+__attribute__((target("pclmul,sse4.1")))
+inline __m128i fold(__m128i x, __m128i k, __m128i next) {
+    __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+    __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+/**
+ * @brief CRC-32 by carry-less multiplication folding, "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009)
+ */
+__attribute__((target("pclmul,sse4.1")))
+inline uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+    if (len < 64)
+        return Crc32::update_table(crc, data, len);
+    alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+    alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+    alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+    alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+    const uint8_t *tail = data + (len & ~(size_t)15);
+    size_t tail_len = len & 15;
+
+    __m128i x0, x1, x2, x3, x4;
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+    data += 64;
+    len -= 64;
+
+    /* fold four 128 bit lanes in parallel */
+    for (; len >= 64; data += 64, len -= 64) {
+        x1 = fold(x1, x0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00)));
+        x2 = fold(x2, x0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10)));
+        x3 = fold(x3, x0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20)));
+        x4 = fold(x4, x0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30)));
+    }
+
+    /* fold the lanes into one, then the remaining 16 byte blocks */
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+    x1 = fold(x1, x0, x2);
+    x1 = fold(x1, x0, x3);
+    x1 = fold(x1, x0, x4);
+    for (; len >= 16; data += 16, len -= 16)
+        x1 = fold(x1, x0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+
+    /* fold 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    crc = (uint32_t)_mm_extract_epi32(x1, 1);
+    return Crc32::update_table(crc, tail, tail_len);
+}
+
+}
+#endif
+
+#if defined(__aarch64__)
+namespace armv8 {
+
+__attribute__((target("+crc")))
+inline uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+    for (; len >= 8; data += 8, len -= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc = __crc32d(crc, word);
+    }
+    for (; len > 0; ++data, --len)
+        crc = __crc32b(crc, *data);
+    return crc;
+}
+
+__attribute__((target("+crc")))
+inline uint32_t crc32c_update(uint32_t crc, const uint8_t *data, size_t len) {
+    for (; len >= 8; data += 8, len -= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc = __crc32cd(crc, word);
+    }
+    for (; len > 0; ++data, --len)
+        crc = __crc32cb(crc, *data);
+    return crc;
+}
+
+}
+#endif
+
+/**
+ * @brief CRC kernel table, chosen once for the running CPU unless switched by use_crc_kernels()
+ */
+struct CrcKernels {
+    const char *name;
+    uint32_t (*crc32)(uint32_t, const uint8_t *, size_t);
+    uint32_t (*crc32c)(uint32_t, const uint8_t *, size_t);
+};
+
+/**
+ * @brief Get the CRC kernel tables usable on the running CPU
+ * @return Tables ordered from the fastest to the lookup tables, the first one is used by default
+ */
+inline const std::vector<CrcKernels>& available_crc_kernels() {
+    static const std::vector<CrcKernels> available = [] {
+        std::vector<CrcKernels> k;
+#if defined(SERIAL_LITE_NO_SIMD)
+#elif defined(__x86_64__) || defined(__i386__)
+        bool sse42 = __builtin_cpu_supports("sse4.2");
+        bool pclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+        if (sse42 && pclmul)
+            k.push_back(CrcKernels{"sse4.2+pclmul", pclmul::crc32_update, sse42::crc32c_update});
+        if (pclmul)
+            k.push_back(CrcKernels{"pclmul", pclmul::crc32_update, Crc32c::update_table});
+        if (sse42)
+            k.push_back(CrcKernels{"sse4.2", Crc32::update_table, sse42::crc32c_update});
+#elif defined(__aarch64__)
+        if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+            k.push_back(CrcKernels{"armv8-crc", armv8::crc32_update, armv8::crc32c_update});
+#endif
+        k.push_back(CrcKernels{"table", Crc32::update_table, Crc32c::update_table});
+        return k;
+    }();
+    return available;
+}
+
+inline CrcKernels& selected_crc_kernels() {
+    static CrcKernels selected = available_crc_kernels().front();
+    return selected;
+}
+
+inline const CrcKernels& crc_kernels() {
+    return selected_crc_kernels();
+}
+
+/**
+ * @brief Switch CRC-32 and CRC-32C to another kernel table, i.e. to compare the kernels
+ * @param name Name of one of the available_crc_kernels()
+ * @return False if no such table is available
+ * @note Not synchronized with checksums computed on other threads
+ */
+inline bool use_crc_kernels(std::string_view name) {
+    for (const CrcKernels& k : available_crc_kernels()) {
+        if (name == k.name) {
+            selected_crc_kernels() = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+    return crc_kernels().crc32(crc, data, len);
+}
+
+inline uint32_t crc32c_update(uint32_t crc, const uint8_t *data, size_t len) {
+    return crc_kernels().crc32c(crc, data, len);
+}
+
+}
+
+/**
+ * @brief Modbus RTU function codes, timing and frame lengths
+ */
+namespace modbus {
+
+constexpr uint8_t read_coils = 0x01;
+constexpr uint8_t read_discrete_inputs = 0x02;
+constexpr uint8_t read_holding_registers = 0x03;
+constexpr uint8_t read_input_registers = 0x04;
+constexpr uint8_t write_single_coil = 0x05;
+constexpr uint8_t write_single_register = 0x06;
+constexpr uint8_t write_multiple_coils = 0x0F;
+constexpr uint8_t write_multiple_registers = 0x10;
+//! set in the function code of exception responses
+constexpr uint8_t exception_flag = 0x80;
+//! longest RTU frame, address + PDU + CRC
+constexpr size_t max_frame = 256;
+
+enum class Status {
+    ok,
+    //! no complete response before the deadline
+    timeout,
+    crc_error,
+    //! the slave answered with an exception code
+    exception,
+    //! wrong address or function, or inconsistent length
+    bad_response,
+    //! invalid arguments, or the device failed
+    failed
+};
+
+/**
+ * @brief Character and silent interval durations on the bus
+ */
+struct Timing {
+    //! one character, nanoseconds
+    uint64_t char_time;
+    //! longest silence within a frame, nanoseconds
+    uint64_t t1_5;
+    //! shortest silence between frames, nanoseconds
+    uint64_t t3_5;
+
+    /**
+   * @brief Derive the intervals from the line settings
+   * @note Above 19200 baud the specification fixes them to 750 us and 1750 us
+   */
+    static constexpr Timing of(const SerialConfig& config) {
+        if (config.baudrate <= 0)
+            return Timing{0, 0, 0};
+        uint64_t char_time = config.char_time();
+        if (config.baudrate > 19200)
+            return Timing{char_time, 750000, 1750000};
+        return Timing{char_time, char_time * 3 / 2, char_time * 7 / 2};
+    }
+};
+
+/**
+ * @brief Get the length of a response frame from its first bytes
+ * @param frame Received bytes
+ * @param len Received length
+ * @return Frame length including the CRC, 0 if more bytes are needed, SIZE_MAX for unknown functions
+ */
+inline size_t response_length(const uint8_t *frame, size_t len) {
+    if (len < 2)
+        return 0;
+    uint8_t function = frame[1];
+    if (function & exception_flag)
+        return 5;
+    switch (function) {
+        case read_coils:
+        case read_discrete_inputs:
+        case read_holding_registers:
+        case read_input_registers:
+            return len < 3 ? 0 : 5 + (size_t)frame[2];
+        case write_single_coil:
+        case write_single_register:
+        case write_multiple_coils:
+        case write_multiple_registers:
+            return 8;
+        default:
+            return SIZE_MAX;
+    }
+}
+
+}
+
+/**
+ * @brief Modbus RTU response frames, checked with the Modbus CRC and handed out without it
+ * @note Requests and responses of the same function differ in length, so this decodes responses only
+ */
+struct ModbusRtuDecoder {
+    /**
+   * @note A length without a matching CRC is taken as a false frame start, and only one byte is
+   * dropped, so that the decoder resynchronizes on the next frame
+   */
+    size_t find_end(const uint8_t *data, size_t len, size_t) const {
+        size_t n = modbus::response_length(data, len);
+        if (n == SIZE_MAX)
+            return 1;
+        if (n == 0 || n > len)
+            return 0;
+        return valid(data, n) ? n : 1;
+    }
+
+    bool decode(uint8_t *data, size_t len, std::span<const uint8_t>& frame) const {
+        if (len < 4)
+            return false;
+        frame = std::span<const uint8_t>(data, len - 2);
+        return true;
+    }
+
+    //! the frame ends with the CRC of its other bytes, little endian
+    static bool valid(const uint8_t *data, size_t len) {
+        return len >= 4 && Crc16Modbus::compute(data, len - 2) == (data[len - 2] | (uint16_t)data[len - 1] << 8);
+    }
+};
+
+/**
+ * @brief Modbus RTU master on a serial bus, one transaction at a time as the protocol requires
+ * @note The bus timing is derived from the device's SerialConfig. Responses are read by their
+ * encoded length instead of waiting for a 3.5 character silence, and the next request is only
+ * held back until 3.5 characters after the end of the last response.
+ */
+class ModbusMaster {
+public:
+    struct Result {
+        modbus::Status status;
+        //! exception code if status is exception
+        uint8_t exception;
+
+        explicit operator bool() const {
+            return status == modbus::Status::ok;
+        }
+    };
+
+    /**
+   * @brief One read of a scan
+   */
+    struct Poll {
+        uint8_t slave;
+        //! read_coils, read_discrete_inputs, read_holding_registers or read_input_registers
+        uint8_t function;
+        uint16_t address;
+        uint16_t count;
+        //! count registers, or count coils as 0 or 1
+        uint16_t *values;
+        //! updated by scan()
+        Result result;
+    };
+
+    /**
+   * @brief Constructor of Modbus master
+   * @param serial Initialized serial device, usually with preset::modbus_rtu, not in async mode
+   * @param response_timeout time allowed for the slave to start answering, nanoseconds
+   */
+    explicit ModbusMaster(Serial& serial, uint64_t response_timeout = 100000000)
+        : serial_(serial), response_timeout_(response_timeout), timing_(modbus::Timing::of(serial.config())) {}
+
+    /**
+   * @brief Recompute the bus timing, needed after the baudrate or framing was changed
+   */
+    void retime() {
+        timing_ = modbus::Timing::of(serial_.config());
+    }
+
+    const modbus::Timing& timing() const {
+        return timing_;
+    }
+
+    void set_response_timeout(uint64_t nanosecond) {
+        response_timeout_ = nanosecond;
+    }
+
+    /**
+   * @brief Time a broadcast is given to be processed before the next request, nanoseconds
+   */
+    void set_turnaround_delay(uint64_t nanosecond) {
+        turnaround_delay_ = nanosecond;
+    }
+
+    Result read_holding_registers(uint8_t slave, uint16_t address, uint16_t count, uint16_t *values) {
+        return read(slave, modbus::read_holding_registers, address, count, values);
+    }
+
+    Result read_input_registers(uint8_t slave, uint16_t address, uint16_t count, uint16_t *values) {
+        return read(slave, modbus::read_input_registers, address, count, values);
+    }
+
+    Result read_coils(uint8_t slave, uint16_t address, uint16_t count, uint16_t *values) {
+        return read(slave, modbus::read_coils, address, count, values);
+    }
+
+    Result read_discrete_inputs(uint8_t slave, uint16_t address, uint16_t count, uint16_t *values) {
+        return read(slave, modbus::read_discrete_inputs, address, count, values);
+    }
+
+    Result write_single_register(uint8_t slave, uint16_t address, uint16_t value) {
+        uint8_t data[] = {(uint8_t)(address >> 8), (uint8_t)address, (uint8_t)(value >> 8), (uint8_t)value};
+        std::span<const uint8_t> response;
+        return transact(slave, modbus::write_single_register, data, sizeof(data), response);
+    }
+
+    Result write_single_coil(uint8_t slave, uint16_t address, bool on) {
+        uint8_t data[] = {(uint8_t)(address >> 8), (uint8_t)address, (uint8_t)(on ? 0xFF : 0x00), 0x00};
+        std::span<const uint8_t> response;
+        return transact(slave, modbus::write_single_coil, data, sizeof(data), response);
+    }
+
+    /**
+   * @brief Write up to 123 consecutive registers
+   */
+    Result write_multiple_registers(uint8_t slave, uint16_t address, const uint16_t *values, uint16_t count) {
+        if (nullptr == values || count == 0 || count > 123)
+            return Result{modbus::Status::failed, 0};
+        uint8_t data[5 + 2 * 123] = {(uint8_t)(address >> 8), (uint8_t)address, (uint8_t)(count >> 8),
+                                     (uint8_t)count, (uint8_t)(count * 2)};
+        for (uint16_t i = 0; i < count; ++i) {
+            data[5 + 2 * i] = (uint8_t)(values[i] >> 8);
+            data[6 + 2 * i] = (uint8_t)values[i];
+        }
+        std::span<const uint8_t> response;
+        return transact(slave, modbus::write_multiple_registers, data, 5 + 2 * count, response);
+    }
+
+    /**
+   * @brief Run the reads back to back, each request leaving as soon as the bus is idle
+   * @param polls Reads to be done, their results are updated
+   * @return Number of successful reads
+   */
+    size_t scan(std::span<Poll> polls) {
+        size_t succeeded = 0;
+        for (Poll& poll : polls) {
+            poll.result = read(poll.slave, poll.function, poll.address, poll.count, poll.values);
+            succeeded += (bool)poll.result;
+        }
+        return succeeded;
+    }
+
+    /**
+   * @brief Send a request and receive its response
+   * @param slave Slave address, 0 broadcasts without a response
+   * @param function Function code
+   * @param data Request data after the function code
+   * @param len Request data length
+   * @param response Updated with the response without CRC, valid until the next transaction
+   * @return Status of the transaction
+   */
+    Result transact(uint8_t slave, uint8_t function, const uint8_t *data, size_t len,
+                    std::span<const uint8_t>& response) {
+        if ((nullptr == data && len > 0) || len > modbus::max_frame - 4)
+            return Result{modbus::Status::failed, 0};
+        /* keep the bus silent for 3.5 characters after the last frame */
+        std::this_thread::sleep_until(idle_at_);
+        /* an earlier late response must not be taken for this one */
+        if (!serial_.discard_input())
+            return Result{modbus::Status::failed, 0};
+
+        frame_[0] = slave;
+        frame_[1] = function;
+        memcpy(frame_ + 2, data, len);
+        uint16_t crc = Crc16Modbus::compute(frame_, len + 2);
+        frame_[len + 2] = (uint8_t)crc;
+        frame_[len + 3] = (uint8_t)(crc >> 8);
+        size_t request_len = len + 4;
+        if (!send(request_len))
+            return finish(Result{modbus::Status::failed, 0});
+        auto sent = std::chrono::steady_clock::now() + std::chrono::nanoseconds(request_len * timing_.char_time);
+        if (slave == 0) {
+            serial_.drain();
+            idle_at_ = std::chrono::steady_clock::now() + std::chrono::nanoseconds(turnaround_delay_);
+            return Result{modbus::Status::ok, 0};
+        }
+
+        /* the header tells how long the rest is, no silence has to be detected */
+        auto deadline = sent + std::chrono::nanoseconds(response_timeout_);
+        ReadProgress progress = serial_.read_exact(frame_, 3, deadline);
+        if (!progress)
+            return finish(Result{modbus::Status::timeout, 0});
+        size_t n = modbus::response_length(frame_, 3);
+        if (n == SIZE_MAX || n > modbus::max_frame)
+            return finish(Result{modbus::Status::bad_response, 0});
+        /* the rest follows back to back, allow for the intra frame silence once */
+        deadline = std::chrono::steady_clock::now() +
+                   std::chrono::nanoseconds((n - 3) * timing_.char_time + timing_.t1_5 + timing_.t3_5);
+        if (!serial_.read_exact(frame_ + 3, n - 3, deadline))
+            return finish(Result{modbus::Status::timeout, 0});
+        if (!ModbusRtuDecoder::valid(frame_, n)) {
+            ++crc_errors_;
+            return finish(Result{modbus::Status::crc_error, 0});
+        }
+        response = std::span<const uint8_t>(frame_, n - 2);
+        if (response[0] != slave || (response[1] & ~modbus::exception_flag) != function)
+            return finish(Result{modbus::Status::bad_response, 0});
+        if (response[1] & modbus::exception_flag)
+            return finish(Result{modbus::Status::exception, response[2]});
+        return finish(Result{modbus::Status::ok, 0});
+    }
+
+    //! number of responses with a wrong CRC
+    size_t crc_errors() const {
+        return crc_errors_;
+    }
+
+    //! number of transactions without a complete response
+    size_t timeouts() const {
+        return timeouts_;
+    }
+
+private:
+    Result read(uint8_t slave, uint8_t function, uint16_t address, uint16_t count, uint16_t *values) {
+        bool bits = function == modbus::read_coils || function == modbus::read_discrete_inputs;
+        if (nullptr == values || count == 0 || count > (bits ? 2000 : 125) || slave == 0)
+            return Result{modbus::Status::failed, 0};
+        uint8_t data[] = {(uint8_t)(address >> 8), (uint8_t)address, (uint8_t)(count >> 8), (uint8_t)count};
+        std::span<const uint8_t> response;
+        Result result = transact(slave, function, data, sizeof(data), response);
+        if (!result)
+            return result;
+        size_t bytes = bits ? (count + 7) / 8 : 2 * (size_t)count;
+        if (response.size() != 3 + bytes || response[2] != bytes)
+            return Result{modbus::Status::bad_response, 0};
+        const uint8_t *payload = response.data() + 3;
+        for (uint16_t i = 0; i < count; ++i)
+            values[i] = bits ? (payload[i / 8] >> (i % 8)) & 1 : (uint16_t)(payload[2 * i] << 8 | payload[2 * i + 1]);
+        return result;
+    }
+
+    //! write the whole request, waiting up to the response timeout whenever the driver is full
+    bool send(size_t len) {
+        size_t done = 0;
+        while (done < len) {
+            long long r = serial_.write(frame_ + done, len - done);
+            if (r > 0) {
+                done += r;
+                continue;
+            }
+            if (r < 0 && errno != EAGAIN && errno != EINTR)
+                return false;
+            pollfd serial_pollfd{serial_.native_handle(), POLLOUT, 0};
+            timespec timeout_ts{(time_t)(response_timeout_ / 1000000000), (long)(response_timeout_ % 1000000000)};
+            int ready = ppoll(&serial_pollfd, 1, &timeout_ts, nullptr);
+            if (ready == 0 || (ready < 0 && errno != EINTR) || (serial_pollfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+                return false;
+        }
+        return true;
+    }
+
+    //! the bus is idle 3.5 characters after now, the end of the response
+    Result finish(Result result) {
+        if (result.status == modbus::Status::timeout)
+            ++timeouts_;
+        idle_at_ = std::chrono::steady_clock::now() + std::chrono::nanoseconds(timing_.t3_5);
+        return result;
+    }
+
+    Serial& serial_;
+    uint64_t response_timeout_;
+    uint64_t turnaround_delay_{100000000};
+    modbus::Timing timing_;
+    //! request and response buffer
+    uint8_t frame_[modbus::max_frame];
+    std::chrono::steady_clock::time_point idle_at_{};
+    size_t crc_errors_{0};
+    size_t timeouts_{0};
 };
 
 }
@@ -0,0 +1,59 @@
+/**
+ * @brief read_until must serve complete lines left over by an earlier call without reading the device
+ */
+#include <cstdio>
+#include <pty.h>
+#include "serial_lite.h"
+
+using namespace serial;
+using Clock = std::chrono::steady_clock;
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+int main() {
+    int master, slave;
+    char name[64];
+    if (openpty(&master, &slave, name, nullptr, nullptr) != 0) {
+        perror("openpty");
+        return 1;
+    }
+    termios raw;
+    tcgetattr(master, &raw);
+    cfmakeraw(&raw);
+    tcsetattr(master, TCSANOW, &raw);
+    Serial serial(name, 115200);
+    if (!serial.init()) {
+        perror("init");
+        return 1;
+    }
+    if (::write(master, "a\nb\nc", 5) != 5)
+        return 1;
+    usleep(20000);
+
+    uint8_t buf[16];
+    ReadProgress first = serial.read_until(buf, sizeof(buf), '\n', Clock::now() + std::chrono::milliseconds(200));
+    expect(first.complete && first.count == 2 && memcmp(buf, "a\n", 2) == 0, "first line is a\\n");
+
+    auto start = Clock::now();
+    ReadProgress second = serial.read_until(buf, sizeof(buf), '\n', start + std::chrono::milliseconds(200));
+    auto waited = Clock::now() - start;
+    expect(second.complete && second.count == 2 && memcmp(buf, "b\n", 2) == 0, "second line is b\\n");
+    expect(waited < std::chrono::milliseconds(50), "second line is served without waiting");
+
+    /* the partial line stays ahead of the bytes that arrive later */
+    if (::write(master, "d\n", 2) != 2)
+        return 1;
+    ReadProgress third = serial.read_until(buf, sizeof(buf), '\n', Clock::now() + std::chrono::milliseconds(200));
+    expect(third.complete && third.count == 3 && memcmp(buf, "cd\n", 3) == 0, "third line is cd\\n");
+
+    close(slave);
+    close(master);
+    return failures == 0 ? 0 : 1;
+}